@@ -0,0 +1,93 @@
+#ifndef PULMOTOR_ALIGNED_HPP_
+#define PULMOTOR_ALIGNED_HPP_
+
+#include "std/vector.hpp"
+
+#include <span>
+
+namespace pulmotor {
+
+// alignment of the data of aligned() arrays of T when none is given, 0 means the page size
+template<class T> struct array_alignment : std::integral_constant<size_t, 0> {};
+
+#define PULMOTOR_ARRAY_ALIGNMENT(T, a) template<> struct ::pulmotor::array_alignment<T> : std::integral_constant<size_t, a> {}
+
+// aligned(c, alignment) stores a contiguous array of primitives (or memory images) so that its data starts
+// at a stream offset that is a multiple of 'alignment':
+//
+//   [u64 element count] [u64 alignment] [padding] [elements]
+//
+// With page alignment the data of a file loaded through a mapped source_mmap starts on a page of its own,
+// and loading into a std::span points the span at the mapping without copying. A std::span<T> (not const)
+// can be loaded only from a writable or copy-on-write (source_mmap::cow) mapping. Arrays smaller than the
+// alignment are only aligned to their element type, the alignment used is stored so readers need not
+// know it.
+template<class T, class C>
+struct aligned_array_t
+{
+	enum { version = pulmotor::no_version };
+
+	static_assert(is_contiguous_element<T>::value, "aligned() is for arrays of primitives or memory images");
+
+	C* c;
+	size_t alignment;
+
+	u64 data_alignment(size_t bytes) const {
+		size_t al = alignment ? alignment : array_alignment<T>::value ? array_alignment<T>::value : util::get_pagesize();
+		assert((al & (al - 1)) == 0 && "alignment must be a power of two");
+		return bytes >= al ? std::max(al, alignof(T)) : alignof(T);
+	}
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		u64 count = c->size();
+		u64 al = data_alignment(count * sizeof(T));
+
+		ar.align_stream(sizeof count);
+		ar.write_basic(count);
+		ar.write_basic(al);
+		ar.align_stream(al);
+		ar.write_data(c->data(), count * sizeof(T));
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 count, al;
+		ar.align_stream(sizeof count);
+		ar.read_basic(count);
+		ar.read_basic(al);
+		ar.align_stream(al);
+
+		if constexpr(std::is_same<C, std::span<T const>>::value || std::is_same<C, std::span<T>>::value) {
+			static_assert(can_borrow<Ar>::value, "spans can only be loaded from an archive that keeps its source in memory (eg. archive_whole)");
+			if constexpr(!std::is_const<typename C::element_type>::value)
+				assert(ar.borrow_writable() && "a mutable span needs a writable or copy-on-write source");
+
+			T const* p = reinterpret_cast<T const*>(ar.borrow_data(count * sizeof(T)));
+			assert(((uintptr_t)p & (alignof(T)-1)) == 0 && "source data is not aligned");
+			*c = C(const_cast<T*>(p), count);
+		} else {
+			c->clear();
+			adopt_memory_resource(ar, *c);
+			c->resize(count);
+			ar.read_data(c->data(), count * sizeof(T));
+		}
+	}
+};
+
+// 'alignment' of 0 uses array_alignment<T>
+template<class T, class Al>
+aligned_array_t<T, std::vector<T, Al>> aligned(std::vector<T, Al>& v, size_t alignment = 0)
+{
+	return aligned_array_t<T, std::vector<T, Al>> { &v, alignment };
+}
+
+template<class T>
+aligned_array_t<std::remove_const_t<T>, std::span<T>> aligned(std::span<T>& s, size_t alignment = 0)
+{
+	return aligned_array_t<std::remove_const_t<T>, std::span<T>> { &s, alignment };
+}
+
+} // pulmotor
+
+#endif // PULMOTOR_ALIGNED_HPP_
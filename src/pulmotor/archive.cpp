@@ -1,3 +1,9 @@
+#include "archive.hpp"
+
+#include <sys/uio.h>
+#include <limits.h>
+#include <errno.h>
+
 namespace pulmotor
 {
 
@@ -6,5 +12,32 @@ char null_32[32] = { 0 };
 //char null_32[32] = { '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-',
 // '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-', '-' };
 
+void archive_iovec_out::flush(int fd, std::error_code& ec)
+{
+	std::vector<iovec> iov;
+	iov.reserve(m_segments.size());
+	for_each_segment([&iov](void const* data, size_t size) { iov.push_back(iovec { const_cast<void*>(data), size }); });
+
+	for (size_t i=0; i<iov.size(); ) {
+		ssize_t w = ::writev(fd, iov.data() + i, (int)std::min<size_t>(iov.size() - i, IOV_MAX));
+		if (w == -1) {
+			if (errno == EINTR)
+				continue;
+			ec = std::make_error_code((std::errc)errno);
+			break;
+		}
+
+		// skip what was written, a partial write leaves the rest of a segment
+		size_t left = w;
+		for (; i<iov.size() && left >= iov[i].iov_len; ++i)
+			left -= iov[i].iov_len;
+		if (left) {
+			iov[i].iov_base = (char*)iov[i].iov_base + left;
+			iov[i].iov_len -= left;
+		}
+	}
+	clear();
+}
+
 }
 
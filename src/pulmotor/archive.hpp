@@ -15,7 +15,10 @@
 #include <string>
 #include <ios>
 #include <fstream>
-#include <unordered_map>
+#include <memory_resource>
+#include <span>
+#include <array>
+#include <functional>
 
 #include "stream.hpp"
 #include "util.hpp"
@@ -47,6 +50,8 @@ struct serialize_context : public serialize_context_tag
 	T& m_object;
 };
 
+class string_table;
+
 struct archive
 {
 	archive() {}
@@ -61,6 +66,34 @@ struct archive
 	void end_object () {}
 
 	void object_name(char const*) {}
+
+	// memory for objects loaded through raw pointers. when null, new/delete is used. with a resource
+	// attached, pointers being overwritten during load are assumed to come from the same resource.
+	std::pmr::memory_resource* memory_resource() const { return m_resource; }
+	void set_memory_resource(std::pmr::memory_resource* r) { m_resource = r; }
+
+	// shared strings (see string_table.hpp). when set, char strings are written once and referenced
+	// afterwards; the reader needs a table attached as well.
+	string_table* strings() const { return m_strings; }
+	void set_string_table(string_table* t) { m_strings = t; }
+
+private:
+	std::pmr::memory_resource* m_resource = nullptr;
+	string_table* m_strings = nullptr;
+};
+
+// temporarily replaces the memory resource of an archive
+template<class Ar>
+struct scoped_memory_resource
+{
+	Ar& ar;
+	std::pmr::memory_resource* prev;
+
+	scoped_memory_resource(Ar& a, std::pmr::memory_resource* r) : ar(a), prev(a.memory_resource()) { ar.set_memory_resource(r); }
+	~scoped_memory_resource() { ar.set_memory_resource(prev); }
+
+	scoped_memory_resource(scoped_memory_resource const&) = delete;
+	scoped_memory_resource& operator=(scoped_memory_resource const&) = delete;
 };
 
 template<class T>
@@ -80,12 +113,17 @@ struct archive_write_util
 			fs_t offset = self().offset();
 			if ((offset & (al-1)) != 0) {
 				size_t write = util::align(offset, al) - offset;
-				assert(write <= 32);
 				self().write_data(null_32, write < 32 ? write : 32);
 			} else
 				break;
 		}
 	}
+
+	// writes memory that does not outlive the call, eg. a scratch buffer. archives that keep references
+	// to written data instead of copying it (archive_iovec_out) copy this.
+	void write_transient(void const* src, size_t size) {
+		self().write_data(src, size);
+	}
 };
 
 template<class Derived>
@@ -93,9 +131,10 @@ struct archive_write_version_util
 {
 	enum { forced_align = 256 };
 
-	//unsigned version_flags() { }
 	archive_write_version_util(unsigned flags) : m_flags(flags) {}
 
+	unsigned version_flags() const { return m_flags; }
+
 	Derived& self() { return *static_cast<Derived*>(this); }
 
 	template<class T>
@@ -105,19 +144,39 @@ struct archive_write_version_util
 	}
 
 	// TODO: assert obj is a "proper" type, for example, not an array
+	// 'flags' may only contain ver_flag_body_size. in that case the offset of the body size is returned
+	// and the object must be finished with end_body_size.
 	template<class T>
-	void write_object_prefix(T const* obj, unsigned version) {
+	fs_t write_object_prefix(T const* obj, unsigned version, unsigned flags = 0) {
 		assert(version != (no_version & ver_mask));
+		assert((flags & ~ver_flag_body_size) == 0);
 
-		u32 vf = version;
+		u32 vf = version | flags;
 		if (obj == nullptr)
 			vf |= ver_flag_null_ptr;
 
-		write_object_prefix_impl(typeid(T).name(), strlen(typeid(T).name()), vf);
+		return write_object_prefix_impl(typeid(T).name(), strlen(typeid(T).name()), vf);
+	}
+
+	// patches in the body size once the object is written. non seekable outputs buffer everything from
+	// the start of the outermost sized object up to here.
+	void end_body_size(fs_t size_at, fs_t body_start) {
+		u32 size = self().offset() - body_start;
+		self().patch(size_at, &size, sizeof size);
+		self().release();
+	}
+
+	// a reference to an already written pointer. only the flags and the id are written, no alignment
+	// or debug string is needed as there is no object data following.
+	void write_ptr_ref(u32 id) {
+		u32 vf = ver_flag_ptr_ref;
+		self().align_stream(sizeof vf);
+		self().write_basic(vf);
+		self().write_basic(id);
 	}
 
 private:
-	void write_object_prefix_impl(char const* obj_name, size_t obj_name_len, unsigned vf)
+	fs_t write_object_prefix_impl(char const* obj_name, size_t obj_name_len, unsigned vf)
 	{
 		fs_t block_size = 0;
 		if ((m_flags & ver_flag_align_object)) {// || (m_flags & ver_flag_debug_string)) {
@@ -143,7 +202,14 @@ private:
 		self().align_stream(sizeof vf);
 		self().write_basic(vf);
 
-		// [version] [garbage_length]? ([string-length] [string-data)? [ ... alignment-data ... ]? [object]
+		// [version] [body_size]? [garbage_length]? ([string-length] [string-data)? [ ... alignment-data ... ]? [object]
+		fs_t size_at = 0;
+		if (vf & ver_flag_body_size) {
+			self().hold();
+			size_at = self().offset();
+			self().write_basic(u32(0));
+		}
+
 		fs_t base = self().offset();
 
 		fs_t objs = 0;
@@ -176,6 +242,7 @@ private:
 #endif
 			assert(self().offset() == util::align(self().offset(), forced_align) && "garbage alignment is not correct");
 		}
+		return size_at;
 	}
 
 private:
@@ -186,10 +253,17 @@ struct object_meta
 {
 	unsigned vf;
 
+	// with ver_flag_body_size: where the body starts and its size. when writing 'body_size' is the
+	// offset of the size that is patched at the end of the object
+	fs_t body_offset = 0;
+	fs_t body_size = 0;
+
 	object_meta& operator=(object_meta const&) = default;
 
 	unsigned version() const { return vf & ver_mask; }
 	unsigned is_nullptr() const { return vf & ver_flag_null_ptr; }
+	unsigned is_ptr_ref() const { return vf & ver_flag_ptr_ref; }
+	unsigned has_body_size() const { return vf & ver_flag_body_size; }
 	bool include_version() const { return (vf & ver_flag_no_version) == 0; }
 	void set_version(unsigned ver) { vf = (vf&~ver_mask) | (ver&ver_mask); }
 
@@ -216,9 +290,13 @@ struct archive_read_util
 
 	object_meta process_prefix() {
 
-		u32 version=0, garbage=0, debug_string_len=0;
+		u32 version=0, body_size=0, garbage=0, debug_string_len=0;
+		align_stream(sizeof version);
 		self().read_basic(version);
 
+		if (version & ver_flag_body_size)
+			self().read_basic(body_size);
+
 		if (version & ver_flag_garbage_length) {
 			self().read_basic(garbage);
 			self().advance(garbage);
@@ -229,61 +307,179 @@ struct archive_read_util
 			}
 		}
 
-		return object_meta{version};
+		return object_meta{version, self().offset(), body_size};
+	}
+
+	// for loaders that find their data malformed (eg. a bit width out of range) or cannot load it with
+	// this archive. the error goes to the archive's ec_, the loader leaves its object empty and returns.
+	void data_error(std::errc e = std::errc::illegal_byte_sequence) {
+		self().ec_ = std::make_error_code(e);
+	}
+
+	// skips whatever is left of an object with a body size (eg. fields added by a newer writer)
+	void end_body_size(object_meta const& m) {
+		fs_t end = m.body_offset + m.body_size;
+		assert(self().offset() <= end && "object read past its body size");
+		if (self().offset() < end)
+			self().advance(end - self().offset());
 	}
 };
 
+// open addressing (linear probing) map from object address to id. a slot with a null pointer is empty,
+// nullptr itself is never tracked. clear() keeps the slot storage around.
+class ptr_id_map
+{
+	struct slot { void* ptr; u32 id; };
+
+	std::vector<slot> m_slots;
+	size_t m_size = 0;
+	unsigned m_shift = 64;
+
+	enum { min_capacity = 64 };
+
+	size_t index(void const* p) const {
+		// fibonacci hashing, top bits of the product select the slot
+		return size_t((u64(uintptr_t(p)) * 0x9e37'79b9'7f4a'7c15ull) >> m_shift);
+	}
+
+	void rehash(size_t capacity) {
+		std::vector<slot> old(capacity, slot{nullptr, 0});
+		old.swap(m_slots);
+
+		m_shift = 64;
+		for (size_t c = capacity; c > 1; c >>= 1)
+			--m_shift;
+
+		size_t mask = capacity - 1;
+		for (slot const& s : old) {
+			if (s.ptr) {
+				size_t i = index(s.ptr);
+				while (m_slots[i].ptr)
+					i = (i + 1) & mask;
+				m_slots[i] = s;
+			}
+		}
+	}
+
+public:
+	size_t size() const { return m_size; }
+	size_t capacity() const { return m_slots.size(); }
+
+	u32 find(void const* p) const {
+		if (m_slots.empty())
+			return 0;
+
+		size_t mask = m_slots.size() - 1;
+		for (size_t i = index(p); m_slots[i].ptr; i = (i + 1) & mask)
+			if (m_slots[i].ptr == p)
+				return m_slots[i].id;
+		return 0;
+	}
+
+	// returns the id already associated with 'p' or associates 'id' with it
+	u32 insert(void* p, u32 id) {
+		assert(p && id);
+		if ((m_size + 1) * 4 > m_slots.size() * 3)
+			rehash(m_slots.empty() ? size_t(min_capacity) : m_slots.size() * 2);
+
+		size_t mask = m_slots.size() - 1;
+		size_t i = index(p);
+		for (; m_slots[i].ptr; i = (i + 1) & mask)
+			if (m_slots[i].ptr == p)
+				return m_slots[i].id;
+
+		m_slots[i] = slot{p, id};
+		++m_size;
+		return id;
+	}
+
+	void reserve(size_t count) {
+		size_t capacity = min_capacity;
+		while (capacity * 3 < count * 4)
+			capacity *= 2;
+		if (capacity > m_slots.size())
+			rehash(capacity);
+	}
+
+	void clear() {
+		std::fill(m_slots.begin(), m_slots.end(), slot{nullptr, 0});
+		m_size = 0;
+	}
+};
+
+// ids are dense and start at 1 (0 means "not tracked"). writing maps address->id, reading
+// maps id->address through a plain vector indexed by id-1.
 template<class Derived>
 struct archive_pointer_support
 {
 	enum { track_pointers = true };
 	Derived& self() { return *static_cast<Derived*>(this); }
 
-	std::unordered_map<void*, u32> m_ptrtoid;
-	std::unordered_map<u32, void*> m_idtoptr;
+	ptr_id_map m_ptrtoid;
+	std::vector<void*> m_idtoptr;
 
 	void restore_ptr(u32 id, void* obj) {
-		assert(m_idtoptr.find(id) == m_idtoptr.end());;
+		assert(id == m_idtoptr.size() + 1 && "pointer ids must be restored in order");
+		m_idtoptr.push_back(obj);
+	}
 
-		m_idtoptr.insert(std::make_pair(id, obj));
-		m_ptrtoid.insert(std::make_pair(obj, id));
+	// reading side: ids are given out in the same order the writer registered them
+	u32 restore_ptr(void* obj) {
+		m_idtoptr.push_back(obj);
+		return m_idtoptr.size();
 	}
-	u32 reg_ptr(void* obj) {
-		auto it = m_ptrtoid.find(obj);
-		if (it != m_ptrtoid.end())
-			return it->second;
 
-		u32 id = m_ptrtoid.size() + 1;
-		m_idtoptr.insert(std::make_pair(id, obj));
-		m_ptrtoid.insert(std::make_pair(obj, id));
-		return id;
+	u32 reg_ptr(void* obj) {
+		return m_ptrtoid.insert(obj, m_ptrtoid.size() + 1);
 	}
 
-	u32 lookup_id(void* ptr) {
-		if (auto it = m_ptrtoid.find(ptr); it != m_ptrtoid.end())
-			return it->second;
-		return 0;
+	u32 lookup_id(void* ptr) const {
+		return m_ptrtoid.find(ptr);
 	}
-	void* lookup_ptr(u32 id) {
-		if (auto it = m_idtoptr.find(id); it != m_idtoptr.end())
-			return it->second;
-		return nullptr;
+	void* lookup_ptr(u32 id) const {
+		return id != 0 && id <= m_idtoptr.size() ? m_idtoptr[id - 1] : nullptr;
+	}
+
+	// forget all tracked pointers but keep the memory, so an archive can be reused for the next message
+	void reset() {
+		m_ptrtoid.clear();
+		m_idtoptr.clear();
 	}
 };
 
-struct archive_whole : archive, archive_read_util<archive_whole>
+template<class Ar, class = void> struct tracks_pointers : std::false_type {};
+template<class Ar>               struct tracks_pointers<Ar, std::void_t<decltype(Ar::track_pointers)>> : std::integral_constant<bool, Ar::track_pointers> {};
+
+// archive can hand out pointers straight into its source data that stay valid after the read (see borrow_data)
+template<class Ar, class = void> struct can_borrow : std::false_type {};
+template<class Ar>               struct can_borrow<Ar, std::void_t<decltype(Ar::can_borrow)>> : std::integral_constant<bool, Ar::can_borrow> {};
+
+struct archive_whole : archive, archive_read_util<archive_whole>, archive_pointer_support<archive_whole>
 {
 	archive_whole (source& s) : source_ (s) {}
 	fs_t offset() const { return source_.offset(); }
 
-	enum { is_reading = 1, is_writing = 0 };
+	// the whole source is available in memory and stays there for the lifetime of the source
+	enum { is_reading = 1, is_writing = 0, can_borrow = 1 };
 
 	void advance(size_t s)
 	{
-		assert(source_.offset() + s <= source_.avail());
+		assert(s <= source_.avail());
 		source_.advance(s, ec_);
 	}
 
+	// returns a pointer to the next 'size' bytes of the source and skips them
+	void const* borrow_data(size_t size)
+	{
+		assert( size <= source_.avail());
+		void const* p = source_.data();
+		source_.advance( size, ec_ );
+		return p;
+	}
+
+	// whether borrowed data may be modified (the source is a writable or copy-on-write mapping)
+	bool borrow_writable() const { return source_.writable(); }
+
 	template<class T>
 	void read_basic(T& data) {
 		assert( sizeof(T) <= source_.avail());
@@ -295,7 +491,8 @@ struct archive_whole : archive, archive_read_util<archive_whole>
 	void read_data (void* dest, size_t size)
 	{
 		assert( size <= source_.avail());
-		memcpy( dest, source_.data(), size);
+		if (size)
+			memcpy( dest, source_.data(), size);
 		source_.advance( size, ec_ );
 	}
 
@@ -305,7 +502,7 @@ private:
 	source& source_;
 };
 
-struct archive_chunked : archive, archive_read_util<archive_chunked>
+struct archive_chunked : archive, archive_read_util<archive_chunked>, archive_pointer_support<archive_chunked>
 {
 	archive_chunked (source& s) : source_ (s) {}
 	fs_t offset() const { return source_.offset(); }
@@ -337,7 +534,7 @@ private:
 	source& source_;
 };
 
-struct archive_istream : archive, archive_read_util<archive_istream>
+struct archive_istream : archive, archive_read_util<archive_istream>, archive_pointer_support<archive_istream>
 {
 	archive_istream (std::istream& s) : stream_ (s), ec_{} {}
 
@@ -617,6 +814,12 @@ struct archive_sink
 	sink& sink_;
 	fs_t written_;
 
+	// when the sink cannot rewrite, data is held here while an object that needs patching is written
+	std::vector<char> held_;
+	fs_t held_at_ = 0;
+	unsigned hold_depth_ = 0;
+	bool holding_ = false;
+
 public:
 	archive_sink (sink& s, unsigned flags = 0)
 		: archive_write_version_util<archive_sink>(flags)
@@ -633,15 +836,45 @@ public:
 	template<class T>
 	void write_basic (T const& data)
 	{
-		sink_.write(&data, sizeof(data), ec);
-		written_ += sizeof data;
+		write_data(&data, sizeof(data));
 	}
 
 	void write_data (void const* src, size_t size)
 	{
-		sink_.write (src, size, ec);
+		if (holding_)
+			held_.insert(held_.end(), (char const*)src, (char const*)src + size);
+		else
+			sink_.write (src, size, ec);
 		written_ += size;
 	}
+
+	// hold/release bracket data that will be patched
+	void hold()
+	{
+		if (hold_depth_++ == 0 && !sink_.can_rewrite()) {
+			holding_ = true;
+			held_at_ = written_;
+		}
+	}
+
+	void release()
+	{
+		assert(hold_depth_ > 0);
+		if (--hold_depth_ == 0 && holding_) {
+			sink_.write(held_.data(), held_.size(), ec);
+			held_.clear();
+			holding_ = false;
+		}
+	}
+
+	void patch(fs_t at, void const* src, size_t size)
+	{
+		assert(at + size <= written_);
+		if (holding_ && at >= held_at_)
+			memcpy(held_.data() + (at - held_at_), src, size);
+		else
+			sink_.rewrite(written_ - at, src, size, ec);
+	}
 };
 
 struct archive_vector_out
@@ -651,13 +884,18 @@ struct archive_vector_out
 	, public archive_pointer_support<archive_vector_out>
 {
 	std::vector<char> data;
+	fs_t base_offset = 0;
 
-	archive_vector_out(unsigned version_flags = 0) : archive_write_version_util<archive_vector_out>(version_flags)
+	// base_offset is the stream offset 'data' will end up at. alignment is computed from it, so a block
+	// written here can be copied into another stream at that offset.
+	archive_vector_out(unsigned version_flags = 0, fs_t base = 0)
+		: archive_write_version_util<archive_vector_out>(version_flags)
+		, base_offset(base)
 	{}
 
 	enum { is_reading = false, is_writing = true };
 
-	size_t offset() const { return data.size(); }
+	size_t offset() const { return base_offset + data.size(); }
 
 	template<class T>
 	void write_basic(T const& a) {
@@ -665,13 +903,312 @@ struct archive_vector_out
 		data.insert(data.end(), p, p + sizeof(a));
 	}
 
-	void write_data(void* src, size_t size) {
+	void write_data(void const* src, size_t size) {
 		data.insert(data.end(), (char const*)src, (char const*)src + size);
 	}
 
+	void hold() {}
+	void release() {}
+	void patch(fs_t at, void const* src, size_t size) {
+		assert(at >= base_offset && at - base_offset + size <= data.size());
+		memcpy(data.data() + (at - base_offset), src, size);
+	}
+
 	std::string str() const { return std::string(data.data(), data.size()); }
 };
 
+// writes into memory provided by the caller. what happens when it is full depends on the policy:
+//  error:    writing stops and 'ec' is set, offset() keeps counting so it tells the size that was needed
+//  spill:    the data moves to a heap buffer and writing continues there (data() stays contiguous)
+//  callback: the full buffer is passed to a callback that returns the next one (an empty span stops
+//            writing as with 'error'). buffers are handed over only between objects that carry a body
+//            size, such an object must fit into the buffer it started in.
+struct archive_buffer_out
+	: public archive
+	, public archive_write_util<archive_buffer_out>
+	, public archive_write_version_util<archive_buffer_out>
+	, public archive_pointer_support<archive_buffer_out>
+{
+	enum class overflow { error, spill, callback };
+
+	// receives the filled part of the current buffer, returns the next buffer
+	using next_buffer_fn = std::function<std::span<char>(std::span<char> filled)>;
+
+private:
+	char* m_begin;
+	char* m_cur;
+	char* m_end;
+	fs_t m_offset = 0;
+	fs_t m_buffer_offset = 0; // stream offset of m_begin
+	overflow m_policy;
+	next_buffer_fn m_next;
+	std::vector<char> m_spill;
+	bool m_spilling = false;
+	bool m_failed = false;
+	unsigned m_hold = 0;
+
+	void fail() {
+		m_failed = true;
+		m_cur = m_end;
+		ec = std::make_error_code(std::errc::no_buffer_space);
+	}
+
+	void write_overflow(char const* src, size_t size) {
+		if (m_failed)
+			return;
+
+		if (m_policy == overflow::spill) {
+			if (!m_spilling) {
+				m_spilling = true;
+				m_spill.reserve(2 * (m_end - m_begin) + size);
+				m_spill.assign(m_begin, m_cur);
+				m_begin = m_cur = m_end = nullptr;
+			}
+			m_spill.insert(m_spill.end(), src, src + size);
+			return;
+		}
+
+		if (m_policy == overflow::callback) {
+			while (size) {
+				size_t part = std::min<size_t>(size, m_end - m_cur);
+				memcpy(m_cur, src, part);
+				m_cur += part;
+				src += part;
+				size -= part;
+				if (!size)
+					break;
+
+				if (m_hold) {
+					fail();
+					return;
+				}
+				std::span<char> next = m_next(std::span<char>(m_begin, m_cur));
+				m_buffer_offset += m_cur - m_begin;
+				m_begin = m_cur = next.data();
+				m_end = m_begin + next.size();
+				if (next.empty()) {
+					fail();
+					return;
+				}
+			}
+			return;
+		}
+
+		fail();
+	}
+
+public:
+	std::error_code ec;
+
+	archive_buffer_out(std::span<char> buffer, unsigned version_flags = 0, overflow policy = overflow::error)
+		: archive_write_version_util<archive_buffer_out>(version_flags)
+		, m_begin(buffer.data()), m_cur(buffer.data()), m_end(buffer.data() + buffer.size())
+		, m_policy(policy)
+	{
+		assert(policy != overflow::callback && "pass the callback to the other constructor");
+	}
+
+	archive_buffer_out(std::span<char> buffer, next_buffer_fn next, unsigned version_flags = 0)
+		: archive_write_version_util<archive_buffer_out>(version_flags)
+		, m_begin(buffer.data()), m_cur(buffer.data()), m_end(buffer.data() + buffer.size())
+		, m_policy(overflow::callback)
+		, m_next(std::move(next))
+	{}
+
+	archive_buffer_out(archive_buffer_out const&) = delete;
+	archive_buffer_out& operator=(archive_buffer_out const&) = delete;
+
+	enum { is_reading = false, is_writing = true };
+
+	size_t offset() const { return m_offset; }
+
+	// true once the data does not fit (error policy, or the callback had no more buffers)
+	bool failed() const { return m_failed; }
+	bool spilled() const { return m_spilling; }
+
+	// the written data of the current buffer: everything with the error and spill policies, the part
+	// not yet passed to the callback otherwise
+	std::span<char const> data() const {
+		if (m_spilling)
+			return std::span<char const>(m_spill.data(), m_spill.size());
+		return std::span<char const>(m_begin, m_cur);
+	}
+
+	template<class T>
+	void write_basic(T const& a) { write_data(&a, sizeof(a)); }
+
+	void write_data(void const* src, size_t size) {
+		m_offset += size;
+		if (size <= size_t(m_end - m_cur)) {
+			memcpy(m_cur, src, size);
+			m_cur += size;
+		} else
+			write_overflow((char const*)src, size);
+	}
+
+	void hold() { ++m_hold; }
+	void release() { assert(m_hold > 0); --m_hold; }
+
+	void patch(fs_t at, void const* src, size_t size) {
+		if (m_failed)
+			return;
+		if (m_spilling) {
+			assert(at + size <= m_spill.size());
+			memcpy(m_spill.data() + at, src, size);
+		} else {
+			assert(at >= m_buffer_offset && at - m_buffer_offset + size <= size_t(m_cur - m_begin));
+			memcpy(m_begin + (at - m_buffer_offset), src, size);
+		}
+	}
+};
+
+// buffers small writes and keeps large ones (from 'threshold' bytes up, typically primitive arrays) as
+// references to the caller's memory, which must stay valid and unchanged until the archive is flushed.
+// flushing writes the buffered and referenced segments in order, to a file descriptor with one writev.
+struct archive_iovec_out
+	: public archive
+	, public archive_write_util<archive_iovec_out>
+	, public archive_write_version_util<archive_iovec_out>
+	, public archive_pointer_support<archive_iovec_out>
+{
+	struct segment
+	{
+		char const* ref; // referenced memory, or null when the data is in the buffer at 'at'
+		size_t at;
+		size_t size;
+		fs_t offset; // stream offset
+	};
+
+private:
+	std::vector<char> m_buffer;
+	std::vector<segment> m_segments;
+	fs_t m_offset = 0;
+	size_t m_threshold;
+	unsigned m_hold = 0;
+
+public:
+	archive_iovec_out(size_t threshold = 4096, unsigned version_flags = 0)
+		: archive_write_version_util<archive_iovec_out>(version_flags)
+		, m_threshold(threshold)
+	{}
+
+	enum { is_reading = false, is_writing = true };
+
+	size_t offset() const { return m_offset; }
+
+	// single values are often temporaries, they are copied whatever the threshold
+	template<class T>
+	void write_basic(T const& a) { write_transient(&a, sizeof(a)); }
+
+	void write_data(void const* src, size_t size) {
+		if (size >= m_threshold) {
+			m_segments.push_back(segment { (char const*)src, 0, size, m_offset });
+			m_offset += size;
+		} else
+			write_transient(src, size);
+	}
+
+	// always buffered, the memory is gone by the time the archive is flushed
+	void write_transient(void const* src, size_t size) {
+		if (size) {
+			if (m_segments.empty() || m_segments.back().ref)
+				m_segments.push_back(segment { nullptr, m_buffer.size(), 0, m_offset });
+			m_buffer.insert(m_buffer.end(), (char const*)src, (char const*)src + size);
+			m_segments.back().size += size;
+		}
+		m_offset += size;
+	}
+
+	void hold() { ++m_hold; }
+	void release() { assert(m_hold > 0); --m_hold; }
+
+	// patched data is always buffered (it is a prefix written with write_basic)
+	void patch(fs_t at, void const* src, size_t size) {
+		for (size_t i=m_segments.size(); i-->0; ) {
+			segment const& s = m_segments[i];
+			if (s.offset <= at) {
+				assert(!s.ref && at + size <= s.offset + s.size && "patching referenced or flushed data");
+				memcpy(m_buffer.data() + s.at + (at - s.offset), src, size);
+				return;
+			}
+		}
+		assert(!"patching flushed data");
+	}
+
+	size_t segment_count() const { return m_segments.size(); }
+	// pending bytes, buffered and referenced
+	size_t size() const { return m_segments.empty() ? 0 : m_offset - m_segments.front().offset; }
+
+	// f(void const* data, size_t size) for every pending segment in order, eg. to fill iovecs for sendmsg
+	template<class F>
+	void for_each_segment(F&& f) const {
+		for (segment const& s : m_segments)
+			f(s.ref ? s.ref : m_buffer.data() + s.at, s.size);
+	}
+
+	// drops the pending segments, the stream offset keeps counting
+	void clear() {
+		assert(m_hold == 0 && "cannot flush in the middle of an object that is patched later");
+		m_segments.clear();
+		m_buffer.clear();
+	}
+
+	void flush(sink& s, std::error_code& ec) {
+		for_each_segment([&](void const* data, size_t size) { if (!ec) s.write(data, size, ec); });
+		clear();
+	}
+
+	void flush(int fd, std::error_code& ec);
+};
+
+// archive_buffer_out with its own fixed storage, eg. on the stack
+template<size_t N>
+struct archive_array_out_storage
+{
+	std::array<char, N> storage;
+};
+
+template<size_t N>
+struct archive_array_out : private archive_array_out_storage<N>, public archive_buffer_out
+{
+	archive_array_out(unsigned version_flags = 0, overflow policy = overflow::error)
+		: archive_buffer_out(std::span<char>(this->storage), version_flags, policy)
+	{}
+};
+
+// runs the same serialization as an output archive but only advances the offset, so it gives the exact
+// encoded size (alignment and prefixes included) without producing the bytes
+struct archive_size_counter
+	: public archive
+	, public archive_write_util<archive_size_counter>
+	, public archive_write_version_util<archive_size_counter>
+	, public archive_pointer_support<archive_size_counter>
+{
+	fs_t base_offset = 0;
+	fs_t m_offset = 0;
+
+	// as with archive_vector_out, 'base' is the stream offset the counted data would be written at
+	archive_size_counter(unsigned version_flags = 0, fs_t base = 0)
+		: archive_write_version_util<archive_size_counter>(version_flags)
+		, base_offset(base)
+		, m_offset(base)
+	{}
+
+	enum { is_reading = false, is_writing = true };
+
+	size_t offset() const { return m_offset; }
+	// bytes counted so far
+	size_t size() const { return m_offset - base_offset; }
+
+	template<class T>
+	void write_basic(T const&) { m_offset += sizeof(T); }
+	void write_data(void const*, size_t size) { m_offset += size; }
+
+	void hold() {}
+	void release() {}
+	void patch(fs_t, void const*, size_t) {}
+};
+
 struct archive_vector_in
 	: public archive
 	, public archive_read_util<archive_vector_in>
@@ -679,6 +1216,7 @@ struct archive_vector_in
 {
 	std::vector<char> data;
 	size_t m_offset = 0;
+	std::error_code ec_;
 	archive_vector_in(std::vector<char> const& i) : data(i) {}
 
 	enum { is_reading = true, is_writing = false };
@@ -692,7 +1230,11 @@ struct archive_vector_in
 	}
 
 	void advance(size_t s) { m_offset += s; }
-	void read_data(void* src, size_t size) { memcpy(src, data.data() + m_offset, size); m_offset += size; }
+	void read_data(void* src, size_t size) {
+		if (size)
+			memcpy(src, data.data() + m_offset, size);
+		m_offset += size;
+	}
 
 	std::string str() const { return std::string(data.data(), data.size()); }
 };
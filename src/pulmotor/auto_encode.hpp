@@ -0,0 +1,451 @@
+#ifndef PULMOTOR_AUTO_ENCODE_HPP_
+#define PULMOTOR_AUTO_ENCODE_HPP_
+
+#include "packed.hpp"
+#include "rle.hpp"
+
+namespace pulmotor {
+
+// encodings auto_encode() chooses from, the values are stored in the tag byte
+enum class array_encoding : u8
+{
+	raw = 0,
+	varint = 1,
+	packed = 2,
+	delta_packed = 3,
+	rle = 4,
+	dictionary = 5,
+};
+
+enum class encode_policy : u8
+{
+	size,	// the smallest estimate
+	speed,	// the fastest to decode among those within a quarter of the smallest estimate
+};
+
+// varint(v) stores integers as uleb128, signed values zigzag encoded:
+//
+//   [u64 count] [u64 byte size] [bytes]
+template<class T, class C>
+struct varint_array_t
+{
+	enum { version = pulmotor::no_version };
+
+	static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value, "varint() is for integer arrays");
+
+	C* c;
+
+	static u64 zigzag(T v) {
+		if constexpr(std::is_signed<T>::value)
+			return (u64(s64(v)) << 1) ^ u64(s64(v) >> 63);
+		else
+			return v;
+	}
+
+	static T unzigzag(u64 z) {
+		if constexpr(std::is_signed<T>::value)
+			return T(s64((z >> 1) ^ (~(z & 1) + 1)));
+		else
+			return T(z);
+	}
+
+	static size_t length(T v) {
+		return std::max<size_t>(1, (std::bit_width(zigzag(v)) + 6) / 7);
+	}
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		std::vector<u8> bytes;
+		bytes.reserve(c->size() * 2);
+		for (T v : *c) {
+			u64 z = zigzag(v);
+			do {
+				bytes.push_back(u8(z & 0x7f) | (z > 0x7f ? 0x80 : 0));
+				z >>= 7;
+			} while (z);
+		}
+
+		u64 count = c->size(), size = bytes.size();
+		ar.align_stream(sizeof count);
+		ar.write_basic(count);
+		ar.write_basic(size);
+		ar.write_transient(bytes.data(), bytes.size());
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 count, size;
+		ar.align_stream(sizeof count);
+		ar.read_basic(count);
+		ar.read_basic(size);
+
+		// every value takes at least one byte
+		c->clear();
+		if (count > size) {
+			ar.data_error();
+			return;
+		}
+
+		adopt_memory_resource(ar, *c);
+		c->resize(count);
+
+		u8 const* p;
+		std::vector<u8> owned;
+		if constexpr(can_borrow<Ar>::value)
+			p = reinterpret_cast<u8 const*>(ar.borrow_data(size));
+		else {
+			owned.resize(size);
+			ar.read_data(owned.data(), size);
+			p = owned.data();
+		}
+
+		// a value cut off by the end of the data, or longer than the ten bytes 64 bits take, fails the load
+		u8 const* end = p + size;
+		T* out = c->data();
+		for (size_t i=0; i<count; ++i) {
+			u64 z = 0;
+			unsigned shift = 0;
+			u8 b;
+			do {
+				if (p == end || (shift == 63 && *p > 1)) {
+					c->clear();
+					ar.data_error();
+					return;
+				}
+				b = *p++;
+				z |= u64(b & 0x7f) << shift;
+				shift += 7;
+			} while (b & 0x80);
+			out[i] = unzigzag(z);
+		}
+	}
+};
+
+// dictionary(v) stores the distinct values once and every element as its index into them, bit packed in
+// blocks of 128 with one width:
+//
+//   [u64 count] [u32 distinct values] [u32 index bits] [padding] [values]* [padding] [u64 packed words]*
+template<class T, class C>
+struct dictionary_array_t
+{
+	enum { version = pulmotor::no_version };
+
+	static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "dictionary() is for arrays of primitives");
+
+	using B = rle_coding::bits_of<T>;
+
+	C* c;
+
+	// distinct value bits in ascending order
+	static std::vector<B> distinct(T const* data, size_t count) {
+		std::vector<B> d(count);
+		memcpy((void*)d.data(), data, count * sizeof(T));
+		std::sort(d.begin(), d.end());
+		d.erase(std::unique(d.begin(), d.end()), d.end());
+		return d;
+	}
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		std::vector<B> dict = distinct(c->data(), c->size());
+		save(ar, dict);
+	}
+
+	template<class Ar>
+	void save(Ar& ar, std::vector<B> const& dict) {
+		u64 count = c->size();
+		u32 size = u32(dict.size()), width = size > 1 ? u32(std::bit_width(size - 1)) : 0;
+
+		ar.align_stream(sizeof count);
+		ar.write_basic(count);
+		ar.write_basic(size);
+		ar.write_basic(width);
+		ar.align_stream(alignof(T));
+		ar.write_transient(dict.data(), dict.size() * sizeof(T));
+		ar.align_stream(sizeof(u64));
+
+		T const* data = c->data();
+		u64 vals[bitpack::block_values];
+		u64 words[bitpack::block_words(32)];
+		for (size_t at=0; at<count; at+=bitpack::block_values) {
+			size_t n = std::min<size_t>(bitpack::block_values, count - at);
+			for (size_t i=0; i<n; ++i) {
+				B b;
+				memcpy(&b, data + at + i, sizeof b);
+				vals[i] = std::lower_bound(dict.begin(), dict.end(), b) - dict.begin();
+			}
+			std::fill(vals + n, vals + bitpack::block_values, u64(0));
+			bitpack::pack(vals, width, words);
+			ar.write_transient(words, bitpack::block_words(width) * sizeof(u64));
+		}
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 count;
+		u32 size, width;
+		ar.align_stream(sizeof count);
+		ar.read_basic(count);
+		ar.read_basic(size);
+		ar.read_basic(width);
+
+		// the index width is the one the writer derives from the dictionary size
+		c->clear();
+		if (width != (size > 1 ? u32(std::bit_width(size - 1)) : 0) || (size == 0 && count != 0)) {
+			ar.data_error();
+			return;
+		}
+
+		std::vector<T> dict(size);
+		ar.align_stream(alignof(T));
+		ar.read_data(dict.data(), size * sizeof(T));
+		ar.align_stream(sizeof(u64));
+
+		adopt_memory_resource(ar, *c);
+		c->resize(count);
+
+		T* out = c->data();
+		u64 vals[bitpack::block_values];
+		u64 words[bitpack::block_words(32)];
+		size_t nwords = bitpack::block_words(width);
+		for (size_t at=0; at<count; at+=bitpack::block_values) {
+			u64 const* packed = words;
+			if constexpr(can_borrow<Ar>::value)
+				packed = reinterpret_cast<u64 const*>(ar.borrow_data(nwords * sizeof(u64)));
+			else
+				ar.read_data(words, nwords * sizeof(u64));
+			bitpack::unpack(packed, width, vals);
+
+			size_t n = std::min<size_t>(bitpack::block_values, count - at);
+			for (size_t i=0; i<n; ++i) {
+				if (vals[i] >= size) {
+					c->clear();
+					ar.data_error();
+					return;
+				}
+				out[at + i] = dict[vals[i]];
+			}
+		}
+	}
+};
+
+template<class T, class Al>
+varint_array_t<T, std::vector<T, Al>> varint(std::vector<T, Al>& v)
+{
+	return varint_array_t<T, std::vector<T, Al>> { &v };
+}
+
+template<class T, class Al>
+dictionary_array_t<T, std::vector<T, Al>> dictionary(std::vector<T, Al>& v)
+{
+	return dictionary_array_t<T, std::vector<T, Al>> { &v };
+}
+
+// auto_encode(v, policy) stores a vector of primitives with the encoding that suits its data, picked from
+// estimates over a sample of the values:
+//
+//   [u8 array_encoding] <the array in that encoding>
+//
+// The sample is a few evenly spread windows of 128 consecutive values (all values of short arrays), so
+// runs and deltas are seen as they are, and choosing costs about as much as encoding 2048 values.
+// Integers can use any encoding; floating point values and enums raw, rle or dictionary.
+template<class T, class C>
+struct auto_encoded_t
+{
+	enum { version = pulmotor::no_version };
+	enum : size_t { window = bitpack::block_values, windows = 16, dictionary_limit = 1 << 16 };
+
+	static_assert((std::is_arithmetic<T>::value || std::is_enum<T>::value) && sizeof(T) <= 8, "auto_encode() is for arrays of primitives");
+
+	static constexpr bool is_int = std::is_integral<T>::value && !std::is_same<T, bool>::value;
+
+	C* c;
+	encode_policy policy;
+
+	// relative decoding cost, lower is faster
+	static unsigned decode_cost(array_encoding e) {
+		switch (e) {
+			case array_encoding::raw: return 0;
+			case array_encoding::rle: return 1;
+			case array_encoding::packed: return 2;
+			case array_encoding::delta_packed: return 2;
+			case array_encoding::dictionary: return 3;
+			case array_encoding::varint: return 4;
+		}
+		return 5;
+	}
+
+	struct estimate
+	{
+		double bytes[6] = {}; // per value, indexed by array_encoding, 0 where not applicable
+		size_t sample_distinct = 0;
+	};
+
+	// estimates the encoded size per value of every applicable encoding
+	static estimate estimate_sizes(T const* data, size_t count) {
+		estimate e;
+		size_t nwin = count <= window * windows ? (count + window - 1) / window : windows;
+		size_t sampled = 0;
+		double varint = 0, packed = 0, delta = 0, rle = 0;
+		std::vector<char> runs;
+		std::vector<rle_coding::bits_of<T>> seen;
+
+		for (size_t w=0; w<nwin; ++w) {
+			size_t at = count <= window * windows ? w * window : (count - window) * w / (windows - 1);
+			size_t n = std::min<size_t>(window, count - at);
+			T const* p = data + at;
+			sampled += n;
+
+			runs.clear();
+			rle_coding::encode(p, n, runs);
+			rle += runs.size();
+
+			for (size_t i=0; i<n; ++i) {
+				rle_coding::bits_of<T> b;
+				memcpy(&b, p + i, sizeof b);
+				seen.push_back(b);
+			}
+
+			if constexpr(is_int) {
+				u64 keys[window], deltas[window];
+				packed_array_t<T, C, false>::transform(p, n, 0, keys);
+				packed_array_t<T, C, true>::transform(p, n, at ? bitpack::to_key(p[-1]) : 0, deltas);
+				auto [klo, khi] = std::minmax_element(keys, keys + n);
+				auto [dlo, dhi] = std::minmax_element(deltas, deltas + n);
+				packed += 9 + std::bit_width(*khi - *klo) * 16.0;
+				delta += 9 + std::bit_width(*dhi - *dlo) * 16.0;
+				for (size_t i=0; i<n; ++i)
+					varint += varint_array_t<T, C>::length(p[i]);
+			}
+		}
+
+		std::sort(seen.begin(), seen.end());
+		e.sample_distinct = std::unique(seen.begin(), seen.end()) - seen.begin();
+
+		auto set = [&](array_encoding k, double total) { e.bytes[size_t(k)] = total / std::max<size_t>(sampled, 1); };
+		e.bytes[size_t(array_encoding::raw)] = sizeof(T);
+		set(array_encoding::rle, rle);
+		if constexpr(is_int) {
+			set(array_encoding::varint, varint);
+			set(array_encoding::packed, packed);
+			set(array_encoding::delta_packed, delta);
+		}
+		// only for low cardinality, the distinct values seen are taken as all there are
+		if (e.sample_distinct * 4 <= sampled) {
+			size_t d = e.sample_distinct;
+			e.bytes[size_t(array_encoding::dictionary)] = (d > 1 ? std::bit_width(d - 1) : 0) / 8.0
+				+ double(d * sizeof(T)) / std::max<size_t>(count, 1);
+		}
+		return e;
+	}
+
+	static array_encoding choose(estimate const& e, encode_policy policy) {
+		array_encoding best = array_encoding::raw;
+		for (size_t k=0; k<6; ++k)
+			if (e.bytes[k] > 0 && e.bytes[k] < e.bytes[size_t(best)])
+				best = array_encoding(k);
+
+		if (policy == encode_policy::speed) {
+			array_encoding fast = best;
+			for (size_t k=0; k<6; ++k)
+				if (e.bytes[k] > 0 && e.bytes[k] <= e.bytes[size_t(best)] * 1.25 && decode_cost(array_encoding(k)) < decode_cost(fast))
+					fast = array_encoding(k);
+			best = fast;
+		}
+		return best;
+	}
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		estimate e = estimate_sizes(c->data(), c->size());
+		array_encoding enc = choose(e, policy);
+
+		std::vector<rle_coding::bits_of<T>> dict;
+		if (enc == array_encoding::dictionary) {
+			// the sample may have missed values, fall back when the whole array is not low cardinality
+			dict = dictionary_array_t<T, C>::distinct(c->data(), c->size());
+			if (dict.size() > dictionary_limit || dict.size() > e.sample_distinct * 4) {
+				e.bytes[size_t(array_encoding::dictionary)] = 0;
+				enc = choose(e, policy);
+			}
+		}
+
+		ar.write_basic(u8(enc));
+		save_as(ar, enc, dict);
+	}
+
+	template<class Ar, class D>
+	void save_as(Ar& ar, array_encoding enc, D const& dict) {
+		switch (enc) {
+			case array_encoding::raw: {
+				u64 count = c->size();
+				ar.align_stream(sizeof count);
+				ar.write_basic(count);
+				ar.align_stream(alignof(T));
+				ar.write_data(c->data(), count * sizeof(T));
+				break;
+			}
+			case array_encoding::rle: rle_array_t<T, C> { c }.serialize_save(ar); break;
+			case array_encoding::dictionary: dictionary_array_t<T, C> { c }.save(ar, dict); break;
+			default:
+				if constexpr(is_int) {
+					if (enc == array_encoding::varint)
+						varint_array_t<T, C> { c }.serialize_save(ar);
+					else if (enc == array_encoding::packed)
+						packed_array_t<T, C, false> { c }.serialize_save(ar);
+					else
+						packed_array_t<T, C, true> { c }.serialize_save(ar);
+				}
+				break;
+		}
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u8 tag;
+		ar.read_basic(tag);
+
+		switch (array_encoding(tag)) {
+			case array_encoding::raw: {
+				u64 count;
+				ar.align_stream(sizeof count);
+				ar.read_basic(count);
+				c->clear();
+				adopt_memory_resource(ar, *c);
+				c->resize(count);
+				ar.align_stream(alignof(T));
+				ar.read_data(c->data(), count * sizeof(T));
+				break;
+			}
+			case array_encoding::rle: rle_array_t<T, C> { c }.serialize_load(ar); break;
+			case array_encoding::dictionary: dictionary_array_t<T, C> { c }.serialize_load(ar); break;
+			case array_encoding::varint:
+			case array_encoding::packed:
+			case array_encoding::delta_packed:
+				if constexpr(is_int) {
+					if (array_encoding(tag) == array_encoding::varint)
+						varint_array_t<T, C> { c }.serialize_load(ar);
+					else if (array_encoding(tag) == array_encoding::packed)
+						packed_array_t<T, C, false> { c }.serialize_load(ar);
+					else
+						packed_array_t<T, C, true> { c }.serialize_load(ar);
+					break;
+				}
+				[[fallthrough]];
+			default:
+				c->clear();
+				ar.data_error();
+				break;
+		}
+	}
+};
+
+template<class T, class Al>
+auto_encoded_t<T, std::vector<T, Al>> auto_encode(std::vector<T, Al>& v, encode_policy policy = encode_policy::size)
+{
+	return auto_encoded_t<T, std::vector<T, Al>> { &v, policy };
+}
+
+} // pulmotor
+
+#endif // PULMOTOR_AUTO_ENCODE_HPP_
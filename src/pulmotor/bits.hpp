@@ -0,0 +1,133 @@
+#ifndef PULMOTOR_BITS_HPP_
+#define PULMOTOR_BITS_HPP_
+
+#include "serialize.hpp"
+
+#include <tuple>
+
+namespace pulmotor {
+
+// bits<N>(x) stores an integer, enum or bool in its low N bits; signed values are sign extended when loaded.
+// On its own it takes (N+7)/8 bytes; bit_fields() packs several of them together.
+template<unsigned N, class T>
+struct bits_t
+{
+	enum { version = pulmotor::no_version };
+	static constexpr unsigned width = N;
+
+	static_assert(N > 0 && N <= 64, "bits<N> takes 1 to 64 bits");
+	static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "bits<N> is for integers, enums and bools");
+
+	using int_t = typename std::conditional_t<std::is_enum<T>::value, std::underlying_type<T>, std::type_identity<T>>::type;
+	using uint_t = std::make_unsigned_t<std::conditional_t<std::is_same<int_t, bool>::value, u8, int_t>>;
+
+	T* v;
+
+	static T from_bits(u64 b) {
+		if constexpr(std::is_same<T, bool>::value)
+			return b != 0;
+		else {
+			if constexpr(std::is_signed<int_t>::value && N < 64)
+				if (b >> (N - 1) & 1)
+					b |= ~u64(0) << N;
+			return T(int_t(uint_t(b)));
+		}
+	}
+
+	u64 get() const {
+		u64 b = u64(uint_t(int_t(*v)));
+		if constexpr(N < 64)
+			b &= (u64(1) << N) - 1;
+		assert(from_bits(b) == *v && "value does not fit into its bits");
+		return b;
+	}
+
+	void set(u64 b) { *v = from_bits(b); }
+
+	template<class Ar> void serialize_save(Ar& ar);
+	template<class Ar> void serialize_load(Ar& ar);
+};
+
+template<class F> struct as_bit_field { using type = F; };
+template<> struct as_bit_field<bool> { using type = bits_t<1, bool>; };
+
+template<unsigned N, class T> inline bits_t<N, T> bit_field(bits_t<N, T> f) { return f; }
+inline bits_t<1, bool> bit_field(bool& b) { return bits_t<1, bool> { &b }; }
+
+// bit_fields(bits<3>(mode), bits<12>(id), flag, ...) writes the fields one after another into as few
+// bytes as they fit in, lowest bits first and without alignment. A bool taken directly uses one bit.
+// The layout is fixed at compile time, changing a width changes the format.
+template<class... F>
+struct bit_group_t
+{
+	enum { version = pulmotor::no_version };
+	enum : unsigned { total = (F::width + ...) };
+	enum : size_t { bytes = (total + 7) / 8, words = (total + 63) / 64 };
+
+	std::tuple<F...> fields;
+
+	static void put(u64* w, unsigned& pos, u64 v, unsigned n) {
+		unsigned shift = pos & 63;
+		w[pos >> 6] |= v << shift;
+		if (shift + n > 64)
+			w[(pos >> 6) + 1] |= v >> (64 - shift);
+		pos += n;
+	}
+
+	static u64 take(u64 const* w, unsigned& pos, unsigned n) {
+		unsigned shift = pos & 63;
+		u64 v = w[pos >> 6] >> shift;
+		if (shift + n > 64)
+			v |= w[(pos >> 6) + 1] << (64 - shift);
+		pos += n;
+		return n < 64 ? v & ((u64(1) << n) - 1) : v;
+	}
+
+	// the bytes of the words are written in memory order, which is the bit order on little endian targets
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		u64 w[words + 1] = {};
+		unsigned pos = 0;
+		std::apply([&](F const&... f) { (put(w, pos, f.get(), F::width), ...); }, fields);
+		ar.write_transient(w, bytes);
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 w[words + 1] = {};
+		ar.read_data(w, bytes);
+		unsigned pos = 0;
+		std::apply([&](F&... f) { (f.set(take(w, pos, F::width)), ...); }, fields);
+	}
+};
+
+template<unsigned N, class T>
+template<class Ar>
+void bits_t<N, T>::serialize_save(Ar& ar)
+{
+	bit_group_t<bits_t> { { *this } }.serialize_save(ar);
+}
+
+template<unsigned N, class T>
+template<class Ar>
+void bits_t<N, T>::serialize_load(Ar& ar)
+{
+	bit_group_t<bits_t> g { { *this } };
+	g.serialize_load(ar);
+}
+
+template<unsigned N, class T>
+bits_t<N, T> bits(T& v)
+{
+	return bits_t<N, T> { &v };
+}
+
+template<class... F>
+bit_group_t<typename as_bit_field<std::remove_cvref_t<F>>::type...> bit_fields(F&&... f)
+{
+	return bit_group_t<typename as_bit_field<std::remove_cvref_t<F>>::type...> { { bit_field(f)... } };
+}
+
+} // pulmotor
+
+#endif // PULMOTOR_BITS_HPP_
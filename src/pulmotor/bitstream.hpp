@@ -0,0 +1,81 @@
+#ifndef PULMOTOR_BITSTREAM_HPP_
+#define PULMOTOR_BITSTREAM_HPP_
+
+#include "pulmotor_types.hpp"
+
+#include <vector>
+#include <cassert>
+
+namespace pulmotor {
+
+// Appends bit fields to a vector of 64 bit words, lowest bits first.
+class bit_writer
+{
+	std::vector<u64> m_words;
+	u64 m_acc = 0;
+	unsigned m_used = 0;
+
+public:
+	// writes the low 'n' bits of 'v', n <= 64
+	void write(u64 v, unsigned n) {
+		if (n == 0)
+			return;
+		if (n < 64)
+			v &= (u64(1) << n) - 1;
+		m_acc |= v << m_used;
+		unsigned total = m_used + n;
+		if (total >= 64) {
+			m_words.push_back(m_acc);
+			m_acc = m_used ? v >> (64 - m_used) : 0;
+			total -= 64;
+		}
+		m_used = total;
+	}
+
+	void write_bit(bool b) { write(b, 1); }
+
+	size_t bit_count() const { return m_words.size() * 64 + m_used; }
+
+	// completes the last word, the writer can not be used afterwards
+	std::vector<u64>& finish() {
+		if (m_used)
+			m_words.push_back(m_acc);
+		m_used = 0;
+		m_acc = 0;
+		return m_words;
+	}
+};
+
+// Reads bit fields written by bit_writer. Reading past the end yields zeros and sets overrun().
+class bit_reader
+{
+	u64 const* m_words;
+	size_t m_count;
+	size_t m_pos = 0;
+
+public:
+	bit_reader(u64 const* words, size_t count) : m_words(words), m_count(count) {}
+
+	u64 read(unsigned n) {
+		if (n == 0)
+			return 0;
+		size_t word = m_pos >> 6;
+		unsigned shift = m_pos & 63;
+		m_pos += n;
+		if (word >= m_count)
+			return 0;
+		u64 v = m_words[word] >> shift;
+		if (shift + n > 64 && word + 1 < m_count)
+			v |= m_words[word + 1] << (64 - shift);
+		return n < 64 ? v & ((u64(1) << n) - 1) : v;
+	}
+
+	bool read_bit() { return read(1) != 0; }
+
+	size_t position() const { return m_pos; }
+	bool overrun() const { return m_pos > m_count * 64; }
+};
+
+} // pulmotor
+
+#endif // PULMOTOR_BITSTREAM_HPP_
@@ -0,0 +1,149 @@
+#ifndef PULMOTOR_COLUMNS_HPP_
+#define PULMOTOR_COLUMNS_HPP_
+
+#include "std/vector.hpp"
+
+namespace pulmotor {
+
+template<class M> struct member_pointer_traits;
+
+template<class C, class F>
+struct member_pointer_traits<F C::*>
+{
+	using class_type = C;
+	using field_type = F;
+};
+
+// columns<&T::a, &T::b, ...>(v) stores a vector of structs field by field (struct-of-arrays), each listed
+// field as one contiguous column:
+//
+//   [u64 row count] [u32 column count] [u32 0] ([padding] [column])*
+//
+// A column holds the field of every row and is aligned to the field type, so columns of a mapped file can
+// be used in place and compress much better than interleaved rows. Fields must be primitives or memory
+// images. Loading can select columns with only<...>(); the others are skipped without being decoded and
+// those fields of the loaded rows are left as they were (rows that already existed keep their values,
+// new rows are value-initialized).
+template<class T, class Al, auto... Fields>
+struct columns_t
+{
+	enum { version = pulmotor::no_version };
+
+	static_assert(sizeof...(Fields) > 0 && sizeof...(Fields) <= 64, "columns() takes 1 to 64 fields");
+	static_assert((std::is_same<typename member_pointer_traits<decltype(Fields)>::class_type, T>::value && ...),
+		"columns() fields must be members of the vector's element type");
+	static_assert((is_contiguous_element<typename member_pointer_traits<decltype(Fields)>::field_type>::value && ...),
+		"columns() fields must be primitives or memory images");
+
+	// columns are moved through a stack buffer of this size
+	enum : size_t { block_size = 4096 };
+
+	std::vector<T, Al>* v;
+	u64 mask; // bit n selects the n-th field for loading
+
+	template<auto A, auto B>
+	static constexpr bool same_field() {
+		if constexpr(std::is_same<decltype(A), decltype(B)>::value)
+			return A == B;
+		else
+			return false;
+	}
+
+	template<auto F>
+	static constexpr u64 field_bit() {
+		u64 bit = 0, n = 0;
+		((bit |= same_field<F, Fields>() ? u64(1) << n : 0, ++n), ...);
+		return bit;
+	}
+
+	// the same columns, loading only the listed fields
+	template<auto... Selected>
+	columns_t only() const {
+		static_assert(((field_bit<Selected>() != 0) && ...), "only() takes fields from the column list");
+		return columns_t { v, (field_bit<Selected>() | ...) };
+	}
+
+	template<auto F, class Ar>
+	void save_column(Ar& ar) {
+		using Tf = typename member_pointer_traits<decltype(F)>::field_type;
+		enum : size_t { per_block = block_size / sizeof(Tf) > 0 ? block_size / sizeof(Tf) : 1 };
+
+		ar.align_stream(alignof(Tf));
+		Tf block[per_block];
+		size_t rows = v->size();
+		for (size_t i=0; i<rows; i+=per_block) {
+			size_t n = std::min<size_t>(per_block, rows - i);
+			T const* row = v->data() + i;
+			for (size_t j=0; j<n; ++j)
+				block[j] = row[j].*F;
+			ar.write_transient(block, n * sizeof(Tf));
+		}
+	}
+
+	template<auto F, class Ar>
+	void load_column(Ar& ar, bool selected) {
+		using Tf = typename member_pointer_traits<decltype(F)>::field_type;
+		enum : size_t { per_block = block_size / sizeof(Tf) > 0 ? block_size / sizeof(Tf) : 1 };
+
+		ar.align_stream(alignof(Tf));
+		size_t rows = v->size();
+		if (!selected) {
+			ar.advance(rows * sizeof(Tf));
+			return;
+		}
+
+		T* row = v->data();
+		if constexpr(can_borrow<Ar>::value) {
+			char const* p = reinterpret_cast<char const*>(ar.borrow_data(rows * sizeof(Tf)));
+			for (size_t i=0; i<rows; ++i)
+				memcpy(&(row[i].*F), p + i * sizeof(Tf), sizeof(Tf));
+		} else {
+			Tf block[per_block];
+			for (size_t i=0; i<rows; i+=per_block) {
+				size_t n = std::min<size_t>(per_block, rows - i);
+				ar.read_data(block, n * sizeof(Tf));
+				for (size_t j=0; j<n; ++j)
+					row[i + j].*F = block[j];
+			}
+		}
+	}
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		u64 rows = v->size();
+		u32 count = sizeof...(Fields), reserved = 0;
+
+		ar.align_stream(sizeof rows);
+		ar.write_basic(rows);
+		ar.write_basic(count);
+		ar.write_basic(reserved);
+		(save_column<Fields>(ar), ...);
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 rows;
+		u32 count, reserved;
+		ar.align_stream(sizeof rows);
+		ar.read_basic(rows);
+		ar.read_basic(count);
+		ar.read_basic(reserved);
+		assert(count == sizeof...(Fields) && "column list does not match the stored columns");
+
+		if (v->empty())
+			adopt_memory_resource(ar, *v);
+		v->resize(rows);
+		u64 n = 0;
+		(load_column<Fields>(ar, (mask >> n++) & 1), ...);
+	}
+};
+
+template<auto... Fields, class T, class Al>
+columns_t<T, Al, Fields...> columns(std::vector<T, Al>& v)
+{
+	return columns_t<T, Al, Fields...> { &v, ~u64(0) };
+}
+
+} // pulmotor
+
+#endif // PULMOTOR_COLUMNS_HPP_
@@ -0,0 +1,119 @@
+#ifndef PULMOTOR_LAZY_HPP_
+#define PULMOTOR_LAZY_HPP_
+
+#include "serialize.hpp"
+
+#include <optional>
+#include <memory>
+
+namespace pulmotor {
+
+// lazy<T> writes its object as a size-prefixed, self-contained block:
+//
+//   [u32 block size] [block: <serializable>]
+//
+// Loading only records where the block is. The object is decoded on first access (or never). Archives that
+// can borrow (archive_whole) keep a pointer into the source, which must outlive the lazy object (and its
+// copies); other archives copy the block bytes. The copy stays alive with the decoded object, shared by
+// copies of the lazy object, as views inside it (string_view, span, a nested lazy) point into it. Pointers
+// are tracked within the block only.
+template<class T>
+class lazy
+{
+	std::optional<T> m_obj;
+
+	char const* m_borrowed = nullptr;
+	fs_t m_offset = 0; // stream offset of the block, alignment inside the block depends on it
+	u32 m_size = 0;
+	u32 m_pad = 0; // where the block starts in m_owned, to keep the alignment it has in the stream
+	bool m_pending = false;
+	std::shared_ptr<std::vector<char>> m_owned;
+
+	char const* block_data() const { return m_borrowed ? m_borrowed : m_owned->data() + m_pad; }
+
+	void decode() {
+		source_buffer sb(block_data(), m_size, m_offset);
+		archive_whole ar(sb);
+
+		if constexpr(wants_construct<archive_whole, T>::value)
+			ar | pulmotor::construct<T>( [this](auto&&... args) { m_obj.emplace(std::forward<decltype(args)>(args)...); });
+		else {
+			m_obj.emplace();
+			ar | *m_obj;
+		}
+		assert(ar.offset() == m_offset + m_size && "lazy block was not consumed entirely");
+
+		m_pending = false;
+		m_borrowed = nullptr;
+	}
+
+public:
+	enum { version = pulmotor::no_version };
+
+	lazy() = default;
+	lazy(T const& o) : m_obj(o) {}
+	lazy(T&& o) : m_obj(std::move(o)) {}
+
+	lazy& operator=(T const& o) { m_obj = o; m_pending = false; m_owned.reset(); return *this; }
+	lazy& operator=(T&& o) { m_obj = std::move(o); m_pending = false; m_owned.reset(); return *this; }
+
+	// true when there is an object, ie. it was assigned or already decoded
+	bool is_loaded() const { return m_obj.has_value(); }
+	// true when a block was loaded that has not been decoded yet
+	bool is_pending() const { return m_pending; }
+
+	// stream offset and size of the pending block
+	fs_t block_offset() const { return m_offset; }
+	size_t block_size() const { return m_size; }
+
+	T& get() {
+		if (!m_obj) {
+			assert(m_pending && "lazy object has neither a value nor a block to decode");
+			decode();
+		}
+		return *m_obj;
+	}
+
+	T& operator*() { return get(); }
+	T* operator->() { return &get(); }
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		T& o = get();
+
+		ar.align_stream(sizeof(u32));
+		fs_t block_offset = ar.offset() + sizeof(u32);
+
+		archive_vector_out block(ar.version_flags(), block_offset);
+		block | o;
+
+		u32 size = block.data.size();
+		ar.write_basic(size);
+		ar.write_transient(block.data.data(), block.data.size());
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		m_obj.reset();
+		m_borrowed = nullptr;
+		m_owned.reset();
+
+		ar.align_stream(sizeof(u32));
+		ar.read_basic(m_size);
+		m_offset = ar.offset();
+
+		if constexpr(can_borrow<Ar>::value) {
+			m_borrowed = reinterpret_cast<char const*>(ar.borrow_data(m_size));
+		} else {
+			// keep the block at the same alignment it has in the stream
+			m_pad = m_offset & (alignof(std::max_align_t) - 1);
+			m_owned = std::make_shared<std::vector<char>>(m_pad + m_size);
+			ar.read_data(m_owned->data() + m_pad, m_size);
+		}
+		m_pending = true;
+	}
+};
+
+} // pulmotor
+
+#endif // PULMOTOR_LAZY_HPP_
@@ -0,0 +1,247 @@
+#ifndef PULMOTOR_PACKED_HPP_
+#define PULMOTOR_PACKED_HPP_
+
+#include "serialize.hpp"
+#include "std/memory_resource.hpp"
+
+#include <array>
+#include <bit>
+#include <utility>
+
+namespace pulmotor {
+
+namespace bitpack {
+
+enum : size_t { block_values = 128 };
+
+// order preserving mapping of an integer to u64 (signed values are biased), and back
+template<class T>
+inline u64 to_key(T v) {
+	using U = std::make_unsigned_t<T>;
+	u64 k = U(v);
+	if constexpr(std::is_signed<T>::value)
+		k ^= u64(1) << (sizeof(T) * 8 - 1);
+	return k;
+}
+
+template<class T>
+inline T from_key(u64 k) {
+	using U = std::make_unsigned_t<T>;
+	if constexpr(std::is_signed<T>::value)
+		k ^= u64(1) << (sizeof(T) * 8 - 1);
+	return T(U(k));
+}
+
+// 128 values of 'w' bits each take exactly 2*w words
+inline size_t block_words(unsigned w) { return 2 * w; }
+
+// 64 values of W bits take exactly W words. the kernels for one width are unrolled with the word index
+// and shift of every value known at compile time, a block is two such groups.
+template<unsigned W, size_t... I>
+inline void pack_group(u64 const* in, u64* out, std::index_sequence<I...>) {
+	std::fill(out, out + W, u64(0));
+	([&] {
+		constexpr size_t word = I * W >> 6;
+		constexpr unsigned shift = I * W & 63;
+		out[word] |= in[I] << shift;
+		if constexpr(shift + W > 64)
+			out[word + 1] |= in[I] >> (64 - shift);
+	}(), ...);
+}
+
+template<unsigned W, size_t... I>
+inline void unpack_group(u64 const* in, u64* out, std::index_sequence<I...>) {
+	constexpr u64 mask = W == 64 ? ~u64(0) : (u64(1) << W) - 1;
+	([&] {
+		constexpr size_t word = I * W >> 6;
+		constexpr unsigned shift = I * W & 63;
+		u64 v = in[word] >> shift;
+		if constexpr(shift + W > 64)
+			v |= in[word + 1] << (64 - shift);
+		out[I] = v & mask;
+	}(), ...);
+}
+
+template<unsigned W>
+void pack_block(u64 const* in, u64* out) {
+	pack_group<W>(in, out, std::make_index_sequence<64>());
+	pack_group<W>(in + 64, out + W, std::make_index_sequence<64>());
+}
+
+template<unsigned W>
+void unpack_block(u64 const* in, u64* out) {
+	unpack_group<W>(in, out, std::make_index_sequence<64>());
+	unpack_group<W>(in + W, out + 64, std::make_index_sequence<64>());
+}
+
+using block_kernel = void (*)(u64 const*, u64*);
+
+template<size_t... W>
+constexpr std::array<block_kernel, sizeof...(W)> pack_kernels(std::index_sequence<W...>) { return { &pack_block<unsigned(W + 1)>... }; }
+
+template<size_t... W>
+constexpr std::array<block_kernel, sizeof...(W)> unpack_kernels(std::index_sequence<W...>) { return { &unpack_block<unsigned(W + 1)>... }; }
+
+// packs block_values values of at most 'w' bits each into block_words(w) words, lowest bits first
+inline void pack(u64 const* in, unsigned w, u64* out) {
+	static constexpr auto kernels = pack_kernels(std::make_index_sequence<64>());
+	assert(w <= 64);
+	if (w != 0)
+		kernels[w - 1](in, out);
+}
+
+inline void unpack(u64 const* in, unsigned w, u64* out) {
+	static constexpr auto kernels = unpack_kernels(std::make_index_sequence<64>());
+	assert(w <= 64);
+	if (w == 0)
+		std::fill(out, out + block_values, u64(0));
+	else
+		kernels[w - 1](in, out);
+}
+
+}
+
+// packed(v) and delta_packed(v) store an array of integers in blocks of 128 values, every block as the
+// offsets from its smallest value packed to as many bits as the largest offset needs:
+//
+//   [u64 count] [u32 delta] [u32 block count] [u8 bit width]* [padding] [u64 block base]* [u64 packed words]*
+//
+// packed() encodes the values themselves (frame of reference), which suits values from a narrow range.
+// delta_packed() encodes the differences between consecutive values, for sorted ids and timestamps. Any
+// sequence round trips, unsorted input only packs less well.
+template<class T, class C, bool Delta>
+struct packed_array_t
+{
+	enum { version = pulmotor::no_version };
+
+	static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value, "packed() is for integer arrays");
+
+	C* c;
+
+	// values as written to the blocks: order preserving keys, or their differences biased by 2^63 so that
+	// small negative and positive steps both end up close to the block base
+	static void transform(T const* in, size_t n, u64 prev, u64* out) {
+		for (size_t i=0; i<n; ++i) {
+			u64 k = bitpack::to_key(in[i]);
+			if constexpr(Delta) {
+				out[i] = (k - prev) ^ (u64(1) << 63);
+				prev = k;
+			} else
+				out[i] = k;
+		}
+	}
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		T const* data = c->data();
+		u64 count = c->size();
+		u32 delta = Delta, blocks = u32((count + bitpack::block_values - 1) / bitpack::block_values);
+
+		std::vector<u8> widths(blocks);
+		std::vector<u64> bases(blocks);
+		u64 vals[bitpack::block_values];
+		u64 prev = 0;
+		for (u32 b=0; b<blocks; ++b) {
+			size_t at = b * bitpack::block_values, n = std::min<size_t>(bitpack::block_values, count - at);
+			transform(data + at, n, prev, vals);
+			if constexpr(Delta)
+				prev = bitpack::to_key(data[at + n - 1]);
+			auto [lo, hi] = std::minmax_element(vals, vals + n);
+			bases[b] = *lo;
+			widths[b] = u8(std::bit_width(*hi - *lo));
+		}
+
+		ar.align_stream(sizeof count);
+		ar.write_basic(count);
+		ar.write_basic(delta);
+		ar.write_basic(blocks);
+		ar.write_transient(widths.data(), widths.size());
+		ar.align_stream(sizeof(u64));
+		ar.write_transient(bases.data(), bases.size() * sizeof(u64));
+
+		u64 words[bitpack::block_words(64)];
+		prev = 0;
+		for (u32 b=0; b<blocks; ++b) {
+			size_t at = b * bitpack::block_values, n = std::min<size_t>(bitpack::block_values, count - at);
+			transform(data + at, n, prev, vals);
+			if constexpr(Delta)
+				prev = bitpack::to_key(data[at + n - 1]);
+			for (size_t i=0; i<n; ++i)
+				vals[i] -= bases[b];
+			std::fill(vals + n, vals + bitpack::block_values, u64(0));
+			bitpack::pack(vals, widths[b], words);
+			ar.write_transient(words, bitpack::block_words(widths[b]) * sizeof(u64));
+		}
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 count;
+		u32 delta, blocks;
+		ar.align_stream(sizeof count);
+		ar.read_basic(count);
+		ar.read_basic(delta);
+		ar.read_basic(blocks);
+
+		// packed() and delta_packed() data are not interchangeable
+		c->clear();
+		if (delta != Delta || blocks != (count + bitpack::block_values - 1) / bitpack::block_values) {
+			ar.data_error();
+			return;
+		}
+
+		std::vector<u8> widths(blocks);
+		std::vector<u64> bases(blocks);
+		ar.read_data(widths.data(), widths.size());
+		ar.align_stream(sizeof(u64));
+		ar.read_data(bases.data(), bases.size() * sizeof(u64));
+		if (std::any_of(widths.begin(), widths.end(), [](u8 w) { return w > 64; })) {
+			ar.data_error();
+			return;
+		}
+
+		adopt_memory_resource(ar, *c);
+		c->resize(count);
+		T* data = c->data();
+
+		u64 vals[bitpack::block_values];
+		u64 words[bitpack::block_words(64)];
+		u64 prev = 0;
+		for (u32 b=0; b<blocks; ++b) {
+			size_t nwords = bitpack::block_words(widths[b]);
+			u64 const* packed = words;
+			if constexpr(can_borrow<Ar>::value)
+				packed = reinterpret_cast<u64 const*>(ar.borrow_data(nwords * sizeof(u64)));
+			else
+				ar.read_data(words, nwords * sizeof(u64));
+			bitpack::unpack(packed, widths[b], vals);
+
+			size_t at = b * bitpack::block_values, n = std::min<size_t>(bitpack::block_values, count - at);
+			u64 base = bases[b];
+			if constexpr(Delta) {
+				// flipping the top bit back is adding 2^63, the prefix sum then restores the keys
+				base += u64(1) << 63;
+				for (size_t i=0; i<n; ++i)
+					data[at + i] = bitpack::from_key<T>(prev += vals[i] + base);
+			} else
+				for (size_t i=0; i<n; ++i)
+					data[at + i] = bitpack::from_key<T>(vals[i] + base);
+		}
+	}
+};
+
+template<class T, class Al>
+packed_array_t<T, std::vector<T, Al>, false> packed(std::vector<T, Al>& v)
+{
+	return packed_array_t<T, std::vector<T, Al>, false> { &v };
+}
+
+template<class T, class Al>
+packed_array_t<T, std::vector<T, Al>, true> delta_packed(std::vector<T, Al>& v)
+{
+	return packed_array_t<T, std::vector<T, Al>, true> { &v };
+}
+
+} // pulmotor
+
+#endif // PULMOTOR_PACKED_HPP_
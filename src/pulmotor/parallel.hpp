@@ -0,0 +1,272 @@
+#ifndef PULMOTOR_PARALLEL_HPP_
+#define PULMOTOR_PARALLEL_HPP_
+
+#include "record_index.hpp"
+#include "std/memory_resource.hpp"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <memory>
+
+namespace pulmotor {
+
+// Item ranges of a set of workers. Each worker consumes its own range from the front; a worker that runs
+// out takes the back half of the largest remaining range, so uneven item costs even out.
+class work_ranges
+{
+	struct alignas(64) slot
+	{
+		std::atomic<u64> range; // [begin:32][end:32]
+	};
+
+	std::unique_ptr<slot[]> m_slots;
+	unsigned m_workers;
+
+	static u64 pack(u32 b, u32 e) { return (u64(b) << 32) | e; }
+	static u32 begin_of(u64 r) { return u32(r >> 32); }
+	static u32 end_of(u64 r) { return u32(r); }
+
+	bool steal(unsigned w) {
+		for (;;) {
+			unsigned victim = m_workers;
+			u32 best = 0;
+			u64 vr = 0;
+			for (unsigned i=0; i<m_workers; ++i) {
+				u64 r = m_slots[i].range.load(std::memory_order_acquire);
+				if (i != w && end_of(r) - begin_of(r) > best) {
+					best = end_of(r) - begin_of(r);
+					victim = i;
+					vr = r;
+				}
+			}
+			if (best == 0)
+				return false;
+
+			u32 mid = end_of(vr) - (best + 1) / 2;
+			if (m_slots[victim].range.compare_exchange_weak(vr, pack(begin_of(vr), mid), std::memory_order_acq_rel)) {
+				m_slots[w].range.store(pack(mid, end_of(vr)), std::memory_order_release);
+				return true;
+			}
+		}
+	}
+
+public:
+	work_ranges(size_t items, unsigned workers) : m_slots(new slot[workers]), m_workers(workers) {
+		assert(items <= std::numeric_limits<u32>::max());
+		for (unsigned i=0; i<workers; ++i)
+			m_slots[i].range.store(pack(u32(items * i / workers), u32(items * (i + 1) / workers)), std::memory_order_relaxed);
+	}
+
+	// next item for worker 'w', false when all items are taken
+	bool next(unsigned w, size_t& item) {
+		for (;;) {
+			u64 r = m_slots[w].range.load(std::memory_order_acquire);
+			if (begin_of(r) < end_of(r)) {
+				if (m_slots[w].range.compare_exchange_weak(r, pack(begin_of(r) + 1, end_of(r)), std::memory_order_acq_rel)) {
+					item = begin_of(r);
+					return true;
+				}
+			} else if (!steal(w))
+				return false;
+		}
+	}
+};
+
+// Calls f(i) for every i in [0, count) on 'threads' threads (the calling one included, 0 means one per
+// hardware thread). The first exception thrown by 'f' is rethrown once all threads have stopped.
+template<class F>
+void parallel_for(size_t count, unsigned threads, F&& f)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	if (threads > count)
+		threads = count ? unsigned(count) : 1u;
+
+	work_ranges ranges(count, threads);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	std::atomic<bool> failed { false };
+
+	auto work = [&](unsigned w) {
+		size_t i;
+		try {
+			while (!failed.load(std::memory_order_relaxed) && ranges.next(w, i))
+				f(i);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(error_mutex);
+			if (!error)
+				error = std::current_exception();
+			failed = true;
+		}
+	};
+
+	std::vector<std::thread> pool;
+	pool.reserve(threads - 1);
+	for (unsigned w=1; w<threads; ++w)
+		pool.emplace_back(work, w);
+	work(0);
+	for (auto& t : pool)
+		t.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+// Decodes all records of an indexed archive into 'out', in record order. Every record is read through its
+// own archive (and pointer tracking state) over the shared data.
+template<class T>
+void parallel_read(record_index_reader const& rr, std::vector<T>& out, unsigned threads = 0)
+{
+	out.resize(rr.size());
+	parallel_for(rr.size(), threads, [&](size_t i) { rr.read(i, out[i]); });
+}
+
+// Writes a vector as independently encoded chunks of elements so that saving and loading can both be
+// spread over threads:
+//
+//   [u64 element count] [u32 chunk count] [u32 elements per chunk] [u64 chunk alignment] [u64 chunk size]*
+//   ([padding] [chunk])*
+//
+// Alignment inside a chunk depends on the stream offset, which is not known while chunks are encoded
+// concurrently. Chunks are therefore encoded as if they started at offset 0 and placed at offsets that
+// are multiples of the largest alignment any of them asked for (at least forced_align with
+// ver_flag_align_object, a page for page aligned() arrays). Pointers are tracked within a chunk only, so
+// elements in different chunks must not share pointees.
+//
+// Memory resources are generally not thread safe, so when the archive carries one that is not known to
+// be (new_delete_resource or a synchronized_pool_resource) the chunks are loaded on the calling thread.
+template<class T, class Al>
+struct parallel_vector_t
+{
+	enum { version = pulmotor::no_version };
+
+	// remembers the largest alignment requested while encoding a chunk
+	struct chunk_out : archive_vector_out
+	{
+		size_t max_align;
+
+		explicit chunk_out(unsigned flags)
+			: archive_vector_out(flags)
+			, max_align(flags & ver_flag_align_object ? size_t(forced_align) : sizeof(u64))
+		{}
+
+		void align_stream(size_t al) {
+			max_align = std::max(max_align, al);
+			archive_vector_out::align_stream(al);
+		}
+	};
+
+	std::vector<T, Al>* v;
+	unsigned threads;
+	size_t chunk_size;
+
+	static bool thread_safe(std::pmr::memory_resource* r) {
+		return !r || r == std::pmr::new_delete_resource() || dynamic_cast<std::pmr::synchronized_pool_resource*>(r);
+	}
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		unsigned nthreads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+		u64 count = v->size();
+		u32 per_chunk = u32(chunk_size ? chunk_size : std::max<size_t>(1, count / (nthreads * 4)));
+		u32 chunks = u32((count + per_chunk - 1) / per_chunk);
+
+		std::vector<std::vector<char>> data(chunks);
+		std::vector<size_t> aligns(chunks, sizeof(u64));
+		unsigned version_flags = ar.version_flags();
+		parallel_for(chunks, nthreads, [&](size_t c) {
+			chunk_out out(version_flags);
+			size_t end = std::min<size_t>(count, (c + 1) * per_chunk);
+			for (size_t i=c * per_chunk; i<end; ++i)
+				out | (*v)[i];
+			data[c] = std::move(out.data);
+			aligns[c] = out.max_align;
+		});
+
+		u64 chunk_align = sizeof(u64);
+		for (size_t a : aligns)
+			chunk_align = std::max<u64>(chunk_align, a);
+
+		ar.align_stream(sizeof count);
+		ar.write_basic(count);
+		ar.write_basic(chunks);
+		ar.write_basic(per_chunk);
+		ar.write_basic(chunk_align);
+		for (auto const& d : data) {
+			u64 size = d.size();
+			ar.write_basic(size);
+		}
+		for (auto const& d : data) {
+			ar.align_stream(chunk_align);
+			ar.write_transient(d.data(), d.size());
+		}
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 count, chunk_align;
+		u32 chunks, per_chunk;
+		ar.align_stream(sizeof count);
+		ar.read_basic(count);
+		ar.read_basic(chunks);
+		ar.read_basic(per_chunk);
+		ar.read_basic(chunk_align);
+		assert((chunk_align & (chunk_align - 1)) == 0 && "bad chunk alignment");
+
+		std::vector<u64> sizes(chunks);
+		for (u64& s : sizes)
+			ar.read_basic(s);
+
+		v->clear();
+		adopt_memory_resource(ar, *v);
+		v->resize(count);
+
+		// locate the chunks, archives that cannot borrow copy them to a buffer with the same alignment
+		std::vector<char const*> data(chunks);
+		std::unique_ptr<char[]> owned;
+		char* dest = nullptr;
+		if constexpr(!can_borrow<Ar>::value) {
+			size_t total = 0;
+			for (u64 s : sizes)
+				total = util::align(total, chunk_align) + s;
+			owned.reset(new char[total + chunk_align]);
+			dest = reinterpret_cast<char*>(util::align(reinterpret_cast<uintptr_t>(owned.get()), chunk_align));
+		}
+		for (u32 c=0; c<chunks; ++c) {
+			ar.align_stream(chunk_align);
+			if constexpr(can_borrow<Ar>::value) {
+				data[c] = reinterpret_cast<char const*>(ar.borrow_data(sizes[c]));
+			} else {
+				dest = reinterpret_cast<char*>(util::align(reinterpret_cast<uintptr_t>(dest), chunk_align));
+				ar.read_data(dest, sizes[c]);
+				data[c] = dest;
+				dest += sizes[c];
+			}
+		}
+
+		std::pmr::memory_resource* resource = ar.memory_resource();
+		parallel_for(chunks, thread_safe(resource) ? threads : 1u, [&](size_t c) {
+			source_buffer sb(data[c], sizes[c]);
+			archive_whole in(sb);
+			in.set_memory_resource(resource);
+			size_t end = std::min<size_t>(count, (c + 1) * per_chunk);
+			for (size_t i=c * per_chunk; i<end; ++i)
+				in | (*v)[i];
+			assert(in.offset() == sizes[c] && "parallel vector chunk was not consumed entirely");
+		});
+	}
+};
+
+// 'threads' of 0 uses one thread per hardware thread, 'chunk_size' of 0 picks a number of elements per
+// chunk that gives each thread a few chunks
+template<class T, class Al>
+parallel_vector_t<T, Al> parallel(std::vector<T, Al>& v, unsigned threads = 0, size_t chunk_size = 0)
+{
+	return parallel_vector_t<T, Al> { &v, threads, chunk_size };
+}
+
+} // pulmotor
+
+#endif // PULMOTOR_PARALLEL_HPP_
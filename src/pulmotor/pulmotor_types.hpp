@@ -55,6 +55,13 @@ enum : unsigned
 	// class is configured not to store the version into file
 	ver_flag_no_version			= 0x0200'0000u,
 
+	// pointer was already written earlier in the stream. u32 id of that object follows instead of the object
+	ver_flag_ptr_ref			= 0x0400'0000u,
+
+	// u32 follows 'version' with the byte length of the object body (the data after the whole prefix). lets
+	// readers skip the object or the part of it they do not know about. opt-in per type through class_flags
+	ver_flag_body_size			= 0x0800'0000u,
+
 	// mask to get only the version part
 	ver_mask					= 0x00ffffffu
 };
@@ -80,12 +87,23 @@ template<class T>               struct has_version_member<T, std::void_t<char [(
 
 template<class T> struct class_version { static unsigned constexpr value = version_default; };
 
+// per type flags that are stored along with the version, currently only ver_flag_body_size
+template<class T> struct class_flags { static unsigned constexpr value = 0u; };
+
 template<class T, class = void> struct get_meta : std::integral_constant<unsigned,
-	(unsigned)class_version<T>::value == (unsigned)no_version ? (unsigned)ver_flag_no_version|0u : (unsigned)class_version<T>::value> {};
+	((unsigned)class_version<T>::value == (unsigned)no_version ? (unsigned)ver_flag_no_version|0u : (unsigned)class_version<T>::value) | (unsigned)class_flags<T>::value> {};
 template<class T>               struct get_meta<T, std::void_t< decltype(T::version) > > : std::integral_constant<unsigned,
-	(unsigned)T::version == (unsigned)no_version ? (unsigned)ver_flag_no_version|0u : (unsigned)T::version> {};
+	((unsigned)T::version == (unsigned)no_version ? (unsigned)ver_flag_no_version|0u : (unsigned)T::version) | (unsigned)class_flags<T>::value> {};
 
 #define PULMOTOR_VERSION(T, v) template<> struct ::pulmotor::class_version<T> { enum { value = v }; }
+#define PULMOTOR_FLAGS(T, f) template<> struct ::pulmotor::class_flags<T> { enum : unsigned { value = f }; }
+
+// opt-in: objects of the type are stored as their memory image, without a prefix and aligned to alignof(T),
+// with a single copy for an object or a whole array of them. only for trivially copyable types that hold
+// no pointers; the layout (and endianness) of the type becomes the stream format.
+template<class T> struct memory_image : std::false_type {};
+
+#define PULMOTOR_MEMORY_IMAGE(T) template<> struct ::pulmotor::memory_image<T> : std::true_type {}
 
 struct romu3
 {
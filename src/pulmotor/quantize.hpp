@@ -0,0 +1,283 @@
+#ifndef PULMOTOR_QUANTIZE_HPP_
+#define PULMOTOR_QUANTIZE_HPP_
+
+#include "packed.hpp"
+
+#include <cmath>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace pulmotor {
+
+namespace f16 {
+
+// float to ieee half with round to nearest even, after https://gist.github.com/rygorous/2156668
+inline u16 from_float(float v) {
+	u32 f;
+	memcpy(&f, &v, sizeof f);
+	u32 sign = f & 0x80000000u;
+	f ^= sign;
+
+	u32 h;
+	if (f >= (127u + 16) << 23) {
+		// overflow to infinity, NaNs stay (quiet) NaNs
+		h = f > 0x7f800000u ? 0x7e00 : 0x7c00;
+	} else if (f < 113u << 23) {
+		// subnormal or zero: adding 0.5 lines the mantissa up and rounds it
+		u32 const magic_bits = 126u << 23;
+		float m, fv;
+		memcpy(&m, &magic_bits, sizeof m);
+		memcpy(&fv, &f, sizeof fv);
+		fv += m;
+		memcpy(&f, &fv, sizeof f);
+		h = f - magic_bits;
+	} else {
+		u32 odd = (f >> 13) & 1;
+		f += (u32(15 - 127) << 23) + 0xfff + odd;
+		h = f >> 13;
+	}
+	return u16(h | (sign >> 16));
+}
+
+inline float to_float(u16 h) {
+	u32 const shifted_exp = 0x7c00u << 13;
+	u32 f = u32(h & 0x7fff) << 13;
+	u32 exp = f & shifted_exp;
+	f += u32(127 - 15) << 23;
+	float v;
+	if (exp == shifted_exp) {
+		f += u32(128 - 16) << 23;
+		memcpy(&v, &f, sizeof v);
+	} else if (exp == 0) {
+		// subnormal: renormalize through a float subtraction
+		f += 1u << 23;
+		u32 const magic_bits = 113u << 23;
+		float m;
+		memcpy(&m, &magic_bits, sizeof m);
+		memcpy(&v, &f, sizeof v);
+		v -= m;
+	} else
+		memcpy(&v, &f, sizeof v);
+
+	u32 r;
+	memcpy(&r, &v, sizeof r);
+	r |= u32(h & 0x8000) << 16;
+	memcpy(&v, &r, sizeof v);
+	return v;
+}
+
+// float to bfloat16 (the upper half of a float) with round to nearest even
+inline u16 bf_from_float(float v) {
+	u32 f;
+	memcpy(&f, &v, sizeof f);
+	if ((f & 0x7fffffffu) > 0x7f800000u)
+		return u16((f >> 16) | 0x40);
+	f += 0x7fff + ((f >> 16) & 1);
+	return u16(f >> 16);
+}
+
+inline float bf_to_float(u16 h) {
+	u32 f = u32(h) << 16;
+	float v;
+	memcpy(&v, &f, sizeof v);
+	return v;
+}
+
+template<bool BFloat, class T>
+void encode(T const* in, size_t n, u16* out) {
+	size_t i = 0;
+#if defined(__F16C__)
+	if constexpr(!BFloat && std::is_same<T, float>::value)
+		for (; i + 8 <= n; i += 8)
+			_mm_storeu_si128((__m128i*)(out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+	for (; i<n; ++i)
+		out[i] = BFloat ? bf_from_float(float(in[i])) : from_float(float(in[i]));
+}
+
+template<bool BFloat, class T>
+void decode(u16 const* in, size_t n, T* out) {
+	size_t i = 0;
+#if defined(__F16C__)
+	if constexpr(!BFloat && std::is_same<T, float>::value)
+		for (; i + 8 <= n; i += 8)
+			_mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((__m128i const*)(in + i))));
+#endif
+	for (; i<n; ++i)
+		out[i] = T(BFloat ? bf_to_float(in[i]) : to_float(in[i]));
+}
+
+}
+
+// half_float(v) and bfloat16(v) store a vector of float or double as 16 bit floats:
+//
+//   [u64 count] [u16 values]*
+//
+// Half floats keep 11 significant bits within +-65504 (larger values become infinity), bfloat16 keeps
+// the float range with 8 significant bits. Values are rounded to nearest, doubles go through float.
+// With F16C enabled (eg. -mf16c) half conversion of floats uses it 8 values at a time.
+template<class T, class C, bool BFloat>
+struct float16_array_t
+{
+	enum { version = pulmotor::no_version };
+	enum : size_t { block_values = 2048 };
+
+	static_assert(std::is_same<T, float>::value || std::is_same<T, double>::value, "half_float() and bfloat16() are for float and double arrays");
+
+	C* c;
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		u64 count = c->size();
+		ar.align_stream(sizeof count);
+		ar.write_basic(count);
+
+		u16 block[block_values];
+		for (size_t at=0; at<count; at+=block_values) {
+			size_t n = std::min<size_t>(block_values, count - at);
+			f16::encode<BFloat>(c->data() + at, n, block);
+			ar.write_transient(block, n * sizeof(u16));
+		}
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 count;
+		ar.align_stream(sizeof count);
+		ar.read_basic(count);
+
+		c->clear();
+		adopt_memory_resource(ar, *c);
+		c->resize(count);
+
+		if constexpr(can_borrow<Ar>::value) {
+			f16::decode<BFloat>(reinterpret_cast<u16 const*>(ar.borrow_data(count * sizeof(u16))), count, c->data());
+		} else {
+			u16 block[block_values];
+			for (size_t at=0; at<count; at+=block_values) {
+				size_t n = std::min<size_t>(block_values, count - at);
+				ar.read_data(block, n * sizeof(u16));
+				f16::decode<BFloat>(block, n, c->data() + at);
+			}
+		}
+	}
+};
+
+// quantize<Bits>(v) stores a vector of finite float or double values as Bits bit fixed point numbers
+// spread evenly between the smallest and the largest value:
+//
+//   [u64 count] [u32 bits] [u32 0] [f64 min] [f64 max] [u64 packed words]*
+//
+// A loaded value is within half a step, (max - min) / (2^bits - 1) / 2, of the original (plus the
+// rounding of T). The minimum and maximum round trip exactly. Loading uses the stored bit count, so any
+// quantize<>() reads data written with another one.
+template<class T, class C, unsigned Bits>
+struct quantized_array_t
+{
+	enum { version = pulmotor::no_version };
+	static constexpr unsigned bits = Bits;
+
+	static_assert(std::is_floating_point<T>::value, "quantize() is for float and double arrays");
+	static_assert(Bits >= 1 && Bits <= 32, "quantize<Bits> takes 1 to 32 bits");
+
+	C* c;
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		T const* data = c->data();
+		u64 count = c->size();
+		double lo = 0, hi = 0;
+		if (count) {
+			auto [mn, mx] = std::minmax_element(data, data + count);
+			lo = *mn;
+			hi = *mx;
+			assert(std::isfinite(lo) && std::isfinite(hi) && "quantize() needs finite values");
+		}
+
+		u32 b = bits, reserved = 0;
+		ar.align_stream(sizeof count);
+		ar.write_basic(count);
+		ar.write_basic(b);
+		ar.write_basic(reserved);
+		ar.write_basic(lo);
+		ar.write_basic(hi);
+
+		double levels = double((u64(1) << bits) - 1);
+		double scale = hi > lo ? levels / (hi - lo) : 0;
+		u64 vals[bitpack::block_values];
+		u64 words[bitpack::block_words(32)];
+		for (size_t at=0; at<count; at+=bitpack::block_values) {
+			size_t n = std::min<size_t>(bitpack::block_values, count - at);
+			for (size_t i=0; i<n; ++i)
+				vals[i] = u64(std::min(levels, (double(data[at + i]) - lo) * scale + 0.5));
+			std::fill(vals + n, vals + bitpack::block_values, u64(0));
+			bitpack::pack(vals, bits, words);
+			ar.write_transient(words, bitpack::block_words(bits) * sizeof(u64));
+		}
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 count;
+		u32 b, reserved;
+		double lo, hi;
+		ar.align_stream(sizeof count);
+		ar.read_basic(count);
+		ar.read_basic(b);
+		ar.read_basic(reserved);
+		ar.read_basic(lo);
+		ar.read_basic(hi);
+
+		c->clear();
+		if (b < 1 || b > 32) {
+			ar.data_error();
+			return;
+		}
+
+		adopt_memory_resource(ar, *c);
+		c->resize(count);
+
+		T* out = c->data();
+		u64 top = (u64(1) << b) - 1;
+		double step = (hi - lo) / double(top);
+		u64 vals[bitpack::block_values];
+		u64 words[bitpack::block_words(32)];
+		size_t nwords = bitpack::block_words(b);
+		for (size_t at=0; at<count; at+=bitpack::block_values) {
+			u64 const* packed = words;
+			if constexpr(can_borrow<Ar>::value)
+				packed = reinterpret_cast<u64 const*>(ar.borrow_data(nwords * sizeof(u64)));
+			else
+				ar.read_data(words, nwords * sizeof(u64));
+			bitpack::unpack(packed, b, vals);
+
+			size_t n = std::min<size_t>(bitpack::block_values, count - at);
+			for (size_t i=0; i<n; ++i)
+				out[at + i] = vals[i] == top ? T(hi) : T(lo + double(vals[i]) * step);
+		}
+	}
+};
+
+template<class T, class Al>
+float16_array_t<T, std::vector<T, Al>, false> half_float(std::vector<T, Al>& v)
+{
+	return float16_array_t<T, std::vector<T, Al>, false> { &v };
+}
+
+template<class T, class Al>
+float16_array_t<T, std::vector<T, Al>, true> bfloat16(std::vector<T, Al>& v)
+{
+	return float16_array_t<T, std::vector<T, Al>, true> { &v };
+}
+
+template<unsigned Bits, class T, class Al>
+quantized_array_t<T, std::vector<T, Al>, Bits> quantize(std::vector<T, Al>& v)
+{
+	return quantized_array_t<T, std::vector<T, Al>, Bits> { &v };
+}
+
+} // pulmotor
+
+#endif // PULMOTOR_QUANTIZE_HPP_
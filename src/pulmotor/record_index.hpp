@@ -0,0 +1,204 @@
+#ifndef PULMOTOR_RECORD_INDEX_HPP_
+#define PULMOTOR_RECORD_INDEX_HPP_
+
+#include "serialize.hpp"
+
+namespace pulmotor {
+
+// An archive made of independent top-level records followed by an index and a trailer:
+//
+//   <record>* [offset deltas: VU*] [key deltas: VU*]? [trailer]
+//
+// Offsets (and the optional keys, which must be non-decreasing) are stored as delta encoded variable
+// length integers. The fixed size trailer is the last thing in the stream so the reader can find the
+// index from the end. Pointer tracking is reset for every record so each can be decoded on its own.
+struct record_trailer
+{
+	static const u32 magic_value = u32('p') | u32('u') << 8 | u32('l') << 16 | u32('X') << 24; // "pulX" in the stream
+
+	enum flags : u32 { has_keys = 0x1 };
+
+	u64 index_offset;
+	u64 count;
+	u32 flags;
+	u32 magic;
+};
+
+template<class Ar>
+class record_index_writer
+{
+	Ar& m_ar;
+	std::vector<fs_t> m_offsets;
+	std::vector<u64> m_keys;
+	bool m_closed = false;
+
+	template<class T>
+	size_t write_record(T const& obj) {
+		assert(!m_closed);
+		if constexpr(tracks_pointers<Ar>::value)
+			m_ar.reset();
+		m_offsets.push_back(m_ar.offset());
+		m_ar | obj;
+		return m_offsets.size() - 1;
+	}
+
+	template<class T>
+	void write_deltas(std::vector<T> const& values) {
+		T prev = 0;
+		for (T v : values) {
+			T delta = v - prev;
+			m_ar | vu<u8>(delta);
+			prev = v;
+		}
+	}
+
+public:
+	explicit record_index_writer(Ar& ar) : m_ar(ar) {}
+	~record_index_writer() { if (!m_closed) close(); }
+
+	record_index_writer(record_index_writer const&) = delete;
+	record_index_writer& operator=(record_index_writer const&) = delete;
+
+	// writes one record and returns its number
+	template<class T>
+	size_t write(T const& obj) {
+		assert(m_keys.empty() && "either all records have a key or none");
+		return write_record(obj);
+	}
+
+	template<class T>
+	size_t write(T const& obj, u64 key) {
+		assert(m_keys.size() == m_offsets.size() && "either all records have a key or none");
+		assert((m_keys.empty() || m_keys.back() <= key) && "record keys must not decrease");
+		m_keys.push_back(key);
+		return write_record(obj);
+	}
+
+	size_t size() const { return m_offsets.size(); }
+
+	// writes the index and the trailer
+	void close() {
+		assert(!m_closed);
+		m_closed = true;
+
+		record_trailer t { m_ar.offset(), m_offsets.size(), 0, record_trailer::magic_value };
+		write_deltas(m_offsets);
+		if (!m_keys.empty()) {
+			t.flags |= record_trailer::has_keys;
+			write_deltas(m_keys);
+		}
+
+		m_ar.align_stream(sizeof(u64));
+		m_ar.write_basic(t.index_offset);
+		m_ar.write_basic(t.count);
+		m_ar.write_basic(t.flags);
+		m_ar.write_basic(t.magic);
+	}
+};
+
+// Random access to the records of an indexed archive. The data must be entirely in memory, eg. a
+// source_mmap mapped as a whole or a source_buffer.
+class record_index_reader
+{
+	char const* m_data = nullptr;
+	size_t m_size = 0;
+	std::vector<fs_t> m_offsets;
+	std::vector<u64> m_keys;
+
+	// false when the index runs past 'end'
+	template<class T>
+	static bool read_deltas(char const*& p, char const* end, std::vector<T>& values, size_t count) {
+		values.resize(count);
+		T prev = 0;
+		for (size_t i=0; i<count; ++i) {
+			size_t delta = 0;
+			int state = 0;
+			do {
+				if (p == end)
+					return false;
+			} while (util::duleb(delta, state, u8(*p++)));
+			values[i] = prev += T(delta);
+		}
+		return true;
+	}
+
+	void fail(std::error_code& ec) {
+		m_offsets.clear();
+		m_keys.clear();
+		ec = std::make_error_code(std::errc::illegal_byte_sequence);
+	}
+
+public:
+	record_index_reader(char const* data, size_t size, std::error_code& ec) : m_data(data), m_size(size)
+	{
+		if (size < sizeof(record_trailer) || ((uintptr_t)data & (alignof(u64) - 1)) != 0) {
+			ec = std::make_error_code(std::errc::invalid_argument);
+			return;
+		}
+
+		size_t const trailer_at = size - sizeof(record_trailer);
+		record_trailer const& t = *reinterpret_cast<record_trailer const*>(data + trailer_at);
+		if (t.magic != record_trailer::magic_value || t.index_offset > trailer_at) {
+			fail(ec);
+			return;
+		}
+
+		// every delta takes at least a byte, check before allocating for 'count' entries
+		size_t const index_size = trailer_at - t.index_offset;
+		size_t const per_record = t.flags & record_trailer::has_keys ? 2 : 1;
+		if (t.count > index_size / per_record) {
+			fail(ec);
+			return;
+		}
+
+		char const* p = data + t.index_offset;
+		char const* end = data + trailer_at;
+		if (!read_deltas(p, end, m_offsets, t.count) || ((t.flags & record_trailer::has_keys) && !read_deltas(p, end, m_keys, t.count))) {
+			fail(ec);
+			return;
+		}
+
+		// records are all in front of the index
+		for (size_t i=0; i<m_offsets.size(); ++i)
+			if (m_offsets[i] > t.index_offset || (i && m_offsets[i] < m_offsets[i-1])) {
+				fail(ec);
+				return;
+			}
+	}
+
+	// 's' must hold the whole archive in memory
+	record_index_reader(source& s, std::error_code& ec)
+		: record_index_reader(s.data() - s.offset(), s.size(), ec)
+	{
+		assert(s.offset() + s.avail() == s.size() && "source must be mapped as a whole");
+	}
+
+	size_t size() const { return m_offsets.size(); }
+	bool has_keys() const { return !m_keys.empty(); }
+
+	fs_t offset(size_t n) const { return m_offsets[n]; }
+	u64 key(size_t n) const { return m_keys[n]; }
+
+	// first record with a key not less than 'key', or size() if there is none
+	size_t find(u64 key) const {
+		assert(has_keys());
+		return std::lower_bound(m_keys.begin(), m_keys.end(), key) - m_keys.begin();
+	}
+
+	// a source positioned at record 'n' and ending with the stream
+	source_buffer record_source(size_t n) const {
+		fs_t off = m_offsets[n];
+		return source_buffer(m_data + off, m_size - off, off);
+	}
+
+	template<class T>
+	void read(size_t n, T& obj) const {
+		source_buffer sb = record_source(n);
+		archive_whole ar(sb);
+		ar | obj;
+	}
+};
+
+} // pulmotor
+
+#endif // PULMOTOR_RECORD_INDEX_HPP_
@@ -0,0 +1,251 @@
+#include "record_log.hpp"
+
+#include <limits>
+
+namespace pulmotor {
+
+u32 record_log_format::checksum(frame_header const& h, void const* payload)
+{
+	u32 crc = util::crc32c(&h.size, sizeof h.size);
+	crc = util::crc32c(&h.seq, sizeof h.seq, crc);
+	return util::crc32c(payload, h.size, crc);
+}
+
+size_t record_log_format::check_frame(char const* p, size_t avail, u64 seq, bool verify)
+{
+	if (avail < frame_header_size)
+		return 0;
+
+	frame_header const& h = *reinterpret_cast<frame_header const*>(p);
+	if (h.seq != seq || h.size > avail - frame_header_size)
+		return 0;
+
+	size_t total = util::align<size_t>(frame_header_size + h.size, frame_align);
+	if (total > avail)
+		return 0;
+
+	if (verify && checksum(h, p + frame_header_size) != h.checksum)
+		return 0;
+
+	return total;
+}
+
+std::basic_string<path_char> record_log_format::segment_path(path_char const* base, unsigned n)
+{
+	std::basic_string<path_char> path(base);
+	path_char digits[9];
+	for (int i=7; i>=0; --i, n /= 10)
+		digits[i] = path_char('0' + n % 10);
+	digits[8] = 0;
+	path += path_char('.');
+	path += digits;
+	return path;
+}
+
+namespace {
+
+bool segment_exists(path_char const* path)
+{
+	std::error_code ec;
+	file_size(path, ec);
+	return !ec;
+}
+
+struct segment_scan
+{
+	bool header_ok = false;
+	u64 first_seq = 0;
+	u64 end_seq = 0;
+	fs_t valid_size = 0;
+	fs_t file_size = 0;
+};
+
+// walks the frames of a segment to find where the valid part ends
+segment_scan scan_segment(path_char const* path, std::error_code& ec)
+{
+	segment_scan r;
+	if ((r.file_size = file_size(path, ec)) < record_log_format::segment_header_size)
+		return r;
+
+	source_mmap sm(path, source_mmap::ro, ec);
+	if (ec)
+		return r;
+
+	char const* data = sm.data();
+	record_log_format::segment_header const& sh = *reinterpret_cast<record_log_format::segment_header const*>(data);
+	if (sh.magic != record_log_format::magic_value || sh.version != record_log_format::version)
+		return r;
+
+	r.header_ok = true;
+	r.first_seq = r.end_seq = sh.first_seq;
+
+	size_t off = record_log_format::segment_header_size;
+	while (size_t frame = record_log_format::check_frame(data + off, r.file_size - off, r.end_seq, true)) {
+		off += frame;
+		++r.end_seq;
+	}
+	r.valid_size = off;
+	return r;
+}
+
+}
+
+record_log_writer::record_log_writer(path_char const* base, fs_t segment_limit, std::error_code& ec, unsigned version_flags)
+	: m_base(base)
+	, m_segment_limit(segment_limit)
+	, m_frame(version_flags)
+{
+	recover(ec);
+}
+
+void record_log_writer::open_segment(unsigned n, u64 first_seq, std::error_code& ec)
+{
+	if (m_file.is_open())
+		m_file.close(ec);
+
+	m_file.open(record_log_format::segment_path(m_base.c_str(), n).c_str(), false, ec);
+	if (ec)
+		return;
+
+	record_log_format::segment_header sh { record_log_format::magic_value, record_log_format::version, first_seq };
+	m_file.write(&sh, sizeof sh, ec);
+
+	m_segment = n;
+	m_next_seq = first_seq;
+}
+
+void record_log_writer::recover(std::error_code& ec)
+{
+	unsigned n = 0;
+	if (!segment_exists(record_log_format::segment_path(m_base.c_str(), 0).c_str())) {
+		open_segment(0, 0, ec);
+		return;
+	}
+	while (segment_exists(record_log_format::segment_path(m_base.c_str(), n + 1).c_str()))
+		++n;
+
+	auto path = record_log_format::segment_path(m_base.c_str(), n);
+	segment_scan last = scan_segment(path.c_str(), ec);
+	if (ec)
+		return;
+
+	if (!last.header_ok) {
+		// the segment was being created, start it over
+		u64 first_seq = 0;
+		if (n > 0) {
+			first_seq = scan_segment(record_log_format::segment_path(m_base.c_str(), n - 1).c_str(), ec).end_seq;
+			if (ec)
+				return;
+		}
+		m_truncated = last.file_size;
+		open_segment(n, first_seq, ec);
+		return;
+	}
+
+	m_file.open(path.c_str(), true, ec);
+	if (ec)
+		return;
+
+	if (last.valid_size < last.file_size) {
+		m_truncated = last.file_size - last.valid_size;
+		m_file.truncate(last.valid_size, ec);
+	}
+	m_segment = n;
+	m_next_seq = last.end_seq;
+}
+
+u64 record_log_writer::append_data(void const* data, size_t size, std::error_code& ec)
+{
+	m_frame.data.resize(record_log_format::frame_header_size);
+	m_frame.write_data(data, size);
+	return write_frame(ec);
+}
+
+u64 record_log_writer::write_frame(std::error_code& ec)
+{
+	size_t size = m_frame.data.size() - record_log_format::frame_header_size;
+	if (size > std::numeric_limits<u32>::max()) {
+		ec = std::make_error_code(std::errc::value_too_large);
+		return m_next_seq;
+	}
+
+	size_t total = util::align<size_t>(m_frame.data.size(), record_log_format::frame_align);
+	m_frame.data.resize(total, 0);
+
+	if (m_file.size() > record_log_format::segment_header_size && m_file.size() + total > m_segment_limit) {
+		open_segment(m_segment + 1, m_next_seq, ec);
+		if (ec)
+			return m_next_seq;
+	}
+
+	record_log_format::frame_header h { u32(size), 0, m_next_seq };
+	h.checksum = record_log_format::checksum(h, m_frame.data.data() + record_log_format::frame_header_size);
+	memcpy(m_frame.data.data(), &h, sizeof h);
+
+	m_file.write(m_frame.data.data(), total, ec);
+	return m_next_seq++;
+}
+
+record_log_reader::record_log_reader(path_char const* base, std::error_code& ec, bool verify_checksums)
+	: m_verify(verify_checksums)
+{
+	for (unsigned n=0; ; ++n) {
+		auto path = record_log_format::segment_path(base, n);
+		std::error_code fec;
+		fs_t size = file_size(path.c_str(), fec);
+		if (fec || size < record_log_format::segment_header_size)
+			break;
+
+		segment s;
+		s.map.reset(new source_mmap(path.c_str(), source_mmap::ro, ec));
+		if (ec)
+			return;
+
+		s.data = s.map->data();
+		s.size = size;
+
+		auto const& sh = *reinterpret_cast<record_log_format::segment_header const*>(s.data);
+		if (sh.magic != record_log_format::magic_value || sh.version != record_log_format::version)
+			break;
+		s.first_seq = sh.first_seq;
+
+		m_segments.push_back(std::move(s));
+	}
+}
+
+record_log_reader::iterator record_log_reader::begin() const
+{
+	if (m_segments.empty())
+		return end();
+
+	iterator i(this, 0);
+	i.m_offset = record_log_format::segment_header_size;
+	i.m_seq = m_segments[0].first_seq;
+	i.settle();
+	return i;
+}
+
+// moves to the next valid frame at or after the current position, or to the end
+void record_log_reader::iterator::settle()
+{
+	auto const& segs = m_log->m_segments;
+	while (m_segment < segs.size()) {
+		record_log_reader::segment const& s = segs[m_segment];
+		if (m_offset < s.size) {
+			if ((m_frame = record_log_format::check_frame(s.data + m_offset, s.size - m_offset, m_seq, m_log->m_verify)))
+				return;
+			break;
+		}
+
+		// continue with the next segment if it starts where this one ended
+		if (++m_segment < segs.size() && segs[m_segment].first_seq != m_seq)
+			break;
+		m_offset = record_log_format::segment_header_size;
+	}
+
+	m_segment = segs.size();
+	m_offset = 0;
+	m_frame = 0;
+}
+
+} // pulmotor
@@ -0,0 +1,162 @@
+#ifndef PULMOTOR_RECORD_LOG_HPP_
+#define PULMOTOR_RECORD_LOG_HPP_
+
+#include "serialize.hpp"
+
+#include <string>
+#include <memory>
+
+namespace pulmotor {
+
+// An append-only log of records split into segment files named <base>.00000000, <base>.00000001, ...
+//
+//   segment: [u32 magic] [u32 version] [u64 sequence number of the first record] <frame>*
+//   frame:   [u32 payload size] [u32 checksum] [u64 sequence number] [payload] [padding]
+//
+// Frames start at 16 byte boundaries. The checksum is crc-32c over the size, the sequence number and the
+// payload, so a frame that was only partially written (or overwritten) is detected. The payload is
+// encoded as if it started at stream offset 16 (ie. offsets are relative to the frame), which keeps
+// the alignment of the data in a mapped segment.
+struct record_log_format
+{
+	static const u32 magic_value = u32('p') | u32('u') << 8 | u32('l') << 16 | u32('L') << 24; // "pulL" in the stream
+	static const u32 version = 1;
+
+	enum : size_t { segment_header_size = 16, frame_header_size = 16, frame_align = 16 };
+
+	struct segment_header
+	{
+		u32 magic;
+		u32 version;
+		u64 first_seq;
+	};
+
+	struct frame_header
+	{
+		u32 size;
+		u32 checksum;
+		u64 seq;
+	};
+
+	static u32 checksum(frame_header const& h, void const* payload);
+
+	// total length of the valid frame with sequence number 'seq' at 'p', or 0 if there is none
+	static size_t check_frame(char const* p, size_t avail, u64 seq, bool verify);
+
+	static std::basic_string<path_char> segment_path(path_char const* base, unsigned n);
+};
+
+// Appends records to a log. Opening an existing log continues after its last valid record: a torn tail
+// (a frame left incomplete by a crash) is cut off. A new segment is started when the current one
+// would grow past 'segment_limit'.
+class record_log_writer
+{
+	std::basic_string<path_char> m_base;
+	fs_t m_segment_limit;
+	sink_file m_file;
+	unsigned m_segment = 0;
+	u64 m_next_seq = 0;
+	fs_t m_truncated = 0;
+
+	// frame being written, the payload is encoded right after the header
+	archive_vector_out m_frame;
+
+	void open_segment(unsigned n, u64 first_seq, std::error_code& ec);
+	void recover(std::error_code& ec);
+	u64 write_frame(std::error_code& ec);
+
+public:
+	record_log_writer(path_char const* base, fs_t segment_limit, std::error_code& ec, unsigned version_flags = 0);
+
+	record_log_writer(record_log_writer const&) = delete;
+	record_log_writer& operator=(record_log_writer const&) = delete;
+
+	// appends one record and returns its sequence number
+	template<class T>
+	u64 append(T const& obj, std::error_code& ec) {
+		m_frame.data.resize(record_log_format::frame_header_size);
+		m_frame.reset();
+		m_frame | obj;
+		return write_frame(ec);
+	}
+
+	// appends an already encoded payload (see the note on offsets above)
+	u64 append_data(void const* data, size_t size, std::error_code& ec);
+
+	void sync(std::error_code& ec) { m_file.sync(ec); }
+	void close(std::error_code& ec) { m_file.close(ec); }
+
+	unsigned segment() const { return m_segment; }
+	u64 next_sequence() const { return m_next_seq; }
+	// number of bytes cut off the tail when the log was opened
+	fs_t truncated() const { return m_truncated; }
+};
+
+// Reads a log by mapping its segments. Iteration yields a source_buffer over each record's payload,
+// pointing straight into the mapped segment, and stops at the first frame that is not valid (eg. the
+// tail a running writer has not finished yet).
+class record_log_reader
+{
+	struct segment
+	{
+		std::unique_ptr<source_mmap> map;
+		char const* data = nullptr;
+		size_t size = 0;
+		u64 first_seq = 0;
+	};
+
+	std::vector<segment> m_segments;
+	bool m_verify;
+
+public:
+	record_log_reader(path_char const* base, std::error_code& ec, bool verify_checksums = true);
+
+	size_t segment_count() const { return m_segments.size(); }
+
+	class iterator
+	{
+		record_log_reader const* m_log = nullptr;
+		size_t m_segment = 0;
+		size_t m_offset = 0;
+		size_t m_frame = 0;
+		u64 m_seq = 0;
+
+		friend class record_log_reader;
+		iterator(record_log_reader const* log, size_t seg) : m_log(log), m_segment(seg) {}
+
+		void settle();
+		record_log_format::frame_header const& header() const {
+			return *reinterpret_cast<record_log_format::frame_header const*>(m_log->m_segments[m_segment].data + m_offset);
+		}
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = source_buffer;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = source_buffer;
+
+		iterator() = default;
+
+		source_buffer operator*() const {
+			return source_buffer(m_log->m_segments[m_segment].data + m_offset + record_log_format::frame_header_size,
+				header().size, record_log_format::frame_header_size);
+		}
+
+		u64 sequence() const { return m_seq; }
+		size_t segment() const { return m_segment; }
+
+		iterator& operator++() { m_offset += m_frame; ++m_seq; settle(); return *this; }
+		iterator operator++(int) { iterator i = *this; ++*this; return i; }
+
+		bool operator==(iterator const& a) const { return m_segment == a.m_segment && m_offset == a.m_offset; }
+		bool operator!=(iterator const& a) const { return !(*this == a); }
+	};
+
+	iterator begin() const;
+	iterator end() const { return iterator(this, m_segments.size()); }
+};
+
+} // pulmotor
+
+#endif // PULMOTOR_RECORD_LOG_HPP_
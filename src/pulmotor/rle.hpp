@@ -0,0 +1,179 @@
+#ifndef PULMOTOR_RLE_HPP_
+#define PULMOTOR_RLE_HPP_
+
+#include "serialize.hpp"
+#include "std/memory_resource.hpp"
+
+namespace pulmotor {
+
+namespace rle_coding {
+
+enum kind : unsigned { zeros = 0, repeat = 1, literal = 2 };
+
+// unsigned type with the size of T, values are compared by their bits (so -0.0 is not a zero and NaNs match)
+template<class T>
+using bits_of = std::conditional_t<sizeof(T) == 1, u8, std::conditional_t<sizeof(T) == 2, u16, std::conditional_t<sizeof(T) == 4, u32, u64>>>;
+
+inline void put_token(std::vector<char>& out, size_t length, kind k) {
+	u8 b[10];
+	size_t n = util::euleb(length << 2 | k, b);
+	out.insert(out.end(), (char const*)b, (char const*)b + n);
+}
+
+// the byte stream of runs:
+//
+//   token: [uleb128 length << 2 | kind] [value, for repeat] [values, for literal]
+//
+// A run is only made where it is shorter than the values it replaces.
+template<class T>
+void encode(T const* in, size_t count, std::vector<char>& out) {
+	using B = bits_of<T>;
+	static_assert(sizeof(B) == sizeof(T), "rle() supports element types of up to 8 bytes");
+
+	auto bits = [in](size_t i) { B b; memcpy(&b, in + i, sizeof b); return b; };
+	auto flush_literal = [&](size_t from, size_t to) {
+		if (from < to) {
+			put_token(out, to - from, literal);
+			out.insert(out.end(), (char const*)(in + from), (char const*)(in + to));
+		}
+	};
+
+	// runs are scanned a word at a time against the value repeated across the word, then by element
+	enum : size_t { per_word = sizeof(u64) / sizeof(T) };
+	auto word = [in](size_t i) { u64 w; memcpy(&w, in + i, sizeof w); return w; };
+
+	size_t lit = 0;
+	for (size_t i=0; i<count; ) {
+		B b = bits(i);
+		u64 pattern = u64(b) * (~u64(0) / B(~B(0)));
+		size_t j = i + 1;
+		while (j + per_word <= count && word(j) == pattern)
+			j += per_word;
+		while (j < count && bits(j) == b)
+			++j;
+
+		size_t run = j - i;
+		bool zero = b == 0;
+		if (run * sizeof(T) > (zero ? 2 : sizeof(T) + 2)) {
+			flush_literal(lit, i);
+			put_token(out, run, zero ? zeros : repeat);
+			if (!zero)
+				out.insert(out.end(), (char const*)(in + i), (char const*)(in + i + 1));
+			lit = j;
+		}
+		i = j;
+	}
+	flush_literal(lit, count);
+}
+
+// false if the runs do not add up to 'count' values within 'size' bytes or a token is cut short
+template<class T>
+bool decode(char const* p, size_t size, T* out, size_t count) {
+	char const* end = p + size;
+	size_t at = 0;
+	while (p < end) {
+		size_t token = 0;
+		int state = 0;
+		bool more = true;
+		while (more && p < end && state < 10)
+			more = util::duleb(token, state, u8(*p++));
+		if (more)
+			return false;
+
+		size_t length = token >> 2;
+		if (length > count - at)
+			return false;
+
+		switch (token & 3) {
+			case zeros:
+				memset((void*)(out + at), 0, length * sizeof(T));
+				break;
+			case repeat: {
+				if (size_t(end - p) < sizeof(T))
+					return false;
+				T v;
+				memcpy(&v, p, sizeof v);
+				p += sizeof(T);
+				std::fill_n(out + at, length, v);
+				break;
+			}
+			case literal:
+				if (size_t(end - p) < length * sizeof(T))
+					return false;
+				memcpy((void*)(out + at), p, length * sizeof(T));
+				p += length * sizeof(T);
+				break;
+			default:
+				return false;
+		}
+		at += length;
+	}
+	return at == count;
+}
+
+}
+
+// rle(v) stores a vector of primitives as runs: runs of zeros, runs of one repeated value and literal
+// stretches of other values, for grids and histograms that are mostly empty or flat:
+//
+//   [u64 count] [u64 byte size] [runs]
+//
+// Values inside the runs are not aligned. Loading expands zero runs with memset and copies literals.
+template<class T, class C>
+struct rle_array_t
+{
+	enum { version = pulmotor::no_version };
+
+	static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "rle() is for arrays of primitives");
+
+	C* c;
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		std::vector<char> runs;
+		rle_coding::encode(c->data(), c->size(), runs);
+
+		u64 count = c->size(), size = runs.size();
+		ar.align_stream(sizeof count);
+		ar.write_basic(count);
+		ar.write_basic(size);
+		ar.write_transient(runs.data(), runs.size());
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 count, size;
+		ar.align_stream(sizeof count);
+		ar.read_basic(count);
+		ar.read_basic(size);
+
+		c->clear();
+		adopt_memory_resource(ar, *c);
+		c->resize(count);
+
+		char const* runs;
+		std::vector<char> owned;
+		if constexpr(can_borrow<Ar>::value)
+			runs = reinterpret_cast<char const*>(ar.borrow_data(size));
+		else {
+			owned.resize(size);
+			ar.read_data(owned.data(), size);
+			runs = owned.data();
+		}
+
+		if (!rle_coding::decode(runs, size, c->data(), count)) {
+			c->clear();
+			ar.data_error();
+		}
+	}
+};
+
+template<class T, class Al>
+rle_array_t<T, std::vector<T, Al>> rle(std::vector<T, Al>& v)
+{
+	return rle_array_t<T, std::vector<T, Al>> { &v };
+}
+
+} // pulmotor
+
+#endif // PULMOTOR_RLE_HPP_
@@ -305,6 +305,27 @@ inline array_ref<T>
 array(T const* p, size_t s)
 { return array_ref<T>{(T*)p, s}; }
 
+// a trivially copyable object stored as its memory image. when loading, 'p' is pointed straight into the
+// source data instead of copying, so it can only be loaded by archives that keep the data alive (can_borrow).
+template<class T>
+struct borrowed
+{
+	static_assert(std::is_trivially_copyable<T>::value, "borrowed<T> requires a trivially copyable T");
+
+	using type = T;
+	T const* p = nullptr;
+
+	borrowed() = default;
+	explicit borrowed(T const* o) : p(o) {}
+
+	T const* get() const { return p; }
+	T const& operator*() const { return *p; }
+	T const* operator->() const { return p; }
+};
+
+template<class T = void>	struct is_borrowed				: std::false_type {};
+template<class T>			struct is_borrowed<borrowed<T>>	: std::true_type {};
+
 template<class S, class Q>
 struct vu_t
 {
@@ -383,12 +404,46 @@ struct logic
 			using Tp = typename std::remove_const<typename std::remove_pointer<Tb>::type>::type;
 			using wc = typename access::wants_construct<Ar, Tp>::type;
 
-			auto new_aligned = []() { return new typename std::aligned_storage<sizeof(Tp)>::type; };
-			auto delete_obj = [](Tp* p) { delete p; };
+			auto new_aligned = [&ar]() -> void* {
+				if (std::pmr::memory_resource* r = ar.memory_resource())
+					return r->allocate(sizeof(Tp), alignof(Tp));
+				return new typename std::aligned_storage<sizeof(Tp)>::type;
+			};
+			auto delete_obj = [&ar](Tp* p) {
+				if (std::pmr::memory_resource* r = ar.memory_resource()) {
+					p->~Tp();
+					r->deallocate(p, sizeof(Tp), alignof(Tp));
+				} else
+					delete p;
+			};
+
+			if constexpr(tracks_pointers<Ar>::value && Ar::is_writing) {
+				if (u32 id = o ? ar.lookup_id((void*)o) : 0) {
+					ar.write_ptr_ref(id);
+					return;
+				}
+			}
 
 			object_meta v = logic<Tp>::s_version(ar, const_cast<Tp*>(o), true);
-			if constexpr(Ar::is_reading)
+			if constexpr(Ar::is_reading) {
+				if constexpr(tracks_pointers<Ar>::value) {
+					if (v.is_ptr_ref()) {
+						logic<Tp>::s_ptr_ref(ar, reinterpret_cast<Tp*&>(o), delete_obj);
+						return;
+					}
+				}
 				logic<Tp>::template prepare_area<wc::value>(reinterpret_cast<Tp**>(&o), !v.is_nullptr(), new_aligned, delete_obj);
+			}
+
+			// register before descending so that cycles back to this object become references
+			if constexpr(tracks_pointers<Ar>::value) {
+				if (o) {
+					if constexpr(Ar::is_reading)
+						ar.restore_ptr((void*)o);
+					else
+						ar.reg_ptr((void*)o);
+				}
+			}
 			logic<Tp>::s_pointer(ar, const_cast<Tp*>(o), v, wc());
 		} else if constexpr(is_alloc<Tb>::value) {
 			using Tp = typename Tb::type;
@@ -452,6 +507,8 @@ struct logic
 			if constexpr(std::rank<Ta>::value == 0) {
 				if constexpr(std::is_arithmetic<Ta>::value || std::is_enum<Ta>::value)
 					logic<Tb>::s_primitive_array(ar, o);
+				else if constexpr(memory_image<Ta>::value)
+					logic<Ta>::s_memory_image(ar, o, std::extent<Tb>::value);
 				else if constexpr(std::is_pointer<Ta>::value) {
 					static_assert(!std::is_same<Ta, Ta>::value, "array of pointers is not supported");
 				} else {
@@ -468,6 +525,8 @@ struct logic
 			using Ta = typename Tb::type;
 			if constexpr(std::is_arithmetic<Ta>::value || std::is_enum<Ta>::value)
 				logic<Ta>::s_primitive_array(ar, o.data, o.size);
+			else if constexpr(memory_image<Ta>::value)
+				logic<Ta>::s_memory_image(ar, o.data, o.size);
 			else if constexpr(std::is_pointer<Ta>::value) {
 				static_assert(!std::is_same<Ta, Ta>::value, "array of pointers is not supported");
 			} else {
@@ -481,11 +540,22 @@ struct logic
 		} else if constexpr(is_vu<Tb>::value) {
 			using Ts = typename Tb::store_type;
 			logic<Ts>::s_vu(ar, *o.q);
+		} else if constexpr(is_borrowed<Tb>::value) {
+			using Tp = typename Tb::type;
+			logic<Tp>::s_borrowed(ar, o.p);
 		} else if constexpr(std::is_arithmetic<Tb>::value || std::is_enum<Tb>::value) {
 			s_primitive(ar, o);
+		} else if constexpr(memory_image<Tb>::value) {
+			s_memory_image(ar, &o, 1);
 		} else if constexpr(std::is_class<Tb>::value || std::is_union<Tb>::value) {
-			object_meta v = s_version(ar, &o, false);
+			object_meta v = s_version(ar, &o, false, true);
 			s_struct(ar, o, v);
+			if (v.has_body_size()) {
+				if constexpr(Ar::is_reading)
+					ar.end_body_size(v);
+				else
+					ar.end_body_size(v.body_size, v.body_offset);
+			}
 		}
 	}
 
@@ -493,7 +563,7 @@ struct logic
 	static void s_vu(Ar& ar, Tq& q)
 	{
 		if constexpr(Ar::is_reading) {
-			size_t u;
+			size_t u = 0;
 			int state=0;
 			Tb v;
 			do {
@@ -503,20 +573,68 @@ struct logic
 		} else if constexpr(Ar::is_writing) {
 			Tb u[util::euleb_count<Tb, Tq>::value];
 			size_t c = util::euleb(q, u);
-			ar.write_data(u, c*sizeof(Tb));
+			ar.write_transient(u, c*sizeof(Tb));
+		}
+	}
+
+	// the pointer refers to an object that was already loaded; drop whatever the pointer held before
+	template<class Ar, class DF>
+	static void s_ptr_ref(Ar& ar, Tb*& o, DF const& dealloc_fun)
+	{
+		u32 id = 0;
+		ar.read_basic(id);
+
+		Tb* p = reinterpret_cast<Tb*>(ar.lookup_ptr(id));
+		assert(p && "pointer reference to an unknown object id");
+		if (o && o != p)
+			logic<Tb>::template prepare_area<access::wants_construct<Ar, Tb>::value>(&o, false, []() { return nullptr; }, dealloc_fun);
+		o = p;
+	}
+
+	template<class Ar>
+	static void s_borrowed(Ar& ar, Tb const*& p)
+	{
+		if constexpr (alignof(Tb) > 1)
+			ar.align_stream(alignof(Tb));
+		if constexpr(Ar::is_reading) {
+			static_assert(can_borrow<Ar>::value, "borrowed data can only be loaded from an archive that keeps its source in memory (eg. archive_whole)");
+			p = reinterpret_cast<Tb const*>(ar.borrow_data(sizeof(Tb)));
+			assert(((uintptr_t)p & (alignof(Tb)-1)) == 0 && "source data is not aligned");
+		} else if constexpr(Ar::is_writing) {
+			assert(p && "writing a null borrowed pointer");
+			ar.write_data(p, sizeof(Tb));
 		}
 	}
 
+	// loads 'size' primitives in place, the counterpart to s_primitive_array when the archive can borrow
+	template<class Ar>
+	static Tb const* s_borrowed_array(Ar& ar, size_t size)
+	{
+		static_assert(can_borrow<Ar>::value, "borrowed data can only be loaded from an archive that keeps its source in memory (eg. archive_whole)");
+		if constexpr (sizeof(Tb) > 1)
+			ar.align_stream(sizeof(Tb));
+		Tb const* p = reinterpret_cast<Tb const*>(ar.borrow_data(size * sizeof(Tb)));
+		assert(((uintptr_t)p & (alignof(Tb)-1)) == 0 && "source data is not aligned");
+		return p;
+	}
+
+	// 'sized' is set only where the end of the object is handled (see ver_flag_body_size), elsewhere the
+	// body size is not written
 	template<class Ar>
-	static object_meta s_version(Ar& ar, Tb* o, bool always_write_verflags)
+	static object_meta s_version(Ar& ar, Tb* o, bool always_write_verflags, bool sized = false)
 	{
 		object_meta v = object_meta { get_meta<Tb>::value };
+		if (!sized)
+			v.vf &= ~ver_flag_body_size;
+
 		if constexpr(Ar::is_reading) {
-			if (v.include_version() || always_write_verflags)
+			if (v.include_version() || always_write_verflags || v.has_body_size())
 				v = ar.process_prefix();
 		} else {
-			if (v.include_version() || always_write_verflags)
-				ar.template write_object_prefix<Tb>(o, v);
+			if (v.include_version() || always_write_verflags || v.has_body_size()) {
+				v.body_size = ar.template write_object_prefix<Tb>(o, v, v.vf & ver_flag_body_size);
+				v.body_offset = ar.offset();
+			}
 		}
 		return v;
 	}
@@ -576,6 +694,17 @@ struct logic
 			ar.write_data(o, size * sizeof(Tb));
 	}
 
+	template<class Ar>
+	static void s_memory_image(Ar& ar, Tb* o, size_t count) {
+		static_assert(std::is_trivially_copyable<Tb>::value, "memory_image requires a trivially copyable type");
+		if constexpr (alignof(Tb) > 1)
+			ar.align_stream(alignof(Tb));
+		if constexpr(Ar::is_reading)
+			ar.read_data(o, count * sizeof(Tb));
+		else
+			ar.write_data(o, count * sizeof(Tb));
+	}
+
 	template<class Ar>
 	static void s_primitive(Ar& ar, Tb& o) {
 		if constexpr (sizeof(Tb) > 1)
@@ -597,6 +726,74 @@ operator| (ArchiveT& ar, T const& obj)
 	return ar;
 }
 
+// skips the next object without decoding it. only objects of types with ver_flag_body_size in their
+// class_flags can be skipped. returns false (and leaves the archive after the prefix) otherwise.
+template<class Ar>
+inline bool skip_object(Ar& ar)
+{
+	static_assert(Ar::is_reading, "only a reading archive can skip");
+	object_meta v = ar.process_prefix();
+	if (!v.has_body_size())
+		return false;
+	ar.end_body_size(v);
+	return true;
+}
+
+// encoded size of a type that does not depend on its value, 0 if it does, and the alignment the encoding
+// starts at (the size holds for an object written at such an offset, see encoded_size for any offset)
+template<class T, class = void>
+struct fixed_encoded_size
+{
+	static constexpr size_t value = 0, alignment = 1;
+};
+
+template<class T>
+struct fixed_encoded_size<T, std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value>>
+{
+	static constexpr size_t value = sizeof(T), alignment = sizeof(T);
+};
+
+template<class T, size_t N>
+struct fixed_encoded_size<T[N], std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value>>
+{
+	static constexpr size_t value = sizeof(T[N]), alignment = sizeof(T[N]);
+};
+
+template<class T>
+struct fixed_encoded_size<T, std::enable_if_t<memory_image<T>::value>>
+{
+	static constexpr size_t value = sizeof(T), alignment = alignof(T);
+};
+
+template<class T, size_t N>
+struct fixed_encoded_size<T[N], std::enable_if_t<memory_image<T>::value>>
+{
+	static constexpr size_t value = sizeof(T[N]), alignment = alignof(T);
+};
+
+// number of bytes 'obj' takes when written at stream offset 'offset' with the given version flags.
+// pointers already written to the target archive would become references there, so for objects sharing
+// pointees with earlier data this is an upper bound.
+template<class T>
+size_t encoded_size(T const& obj, unsigned version_flags = 0, fs_t offset = 0)
+{
+	using fixed = fixed_encoded_size<T>;
+	if constexpr(fixed::value != 0 && (fixed::alignment & (fixed::alignment - 1)) == 0) {
+		return util::align(offset, fixed::alignment) - offset + fixed::value;
+	} else {
+		archive_size_counter ar(version_flags, offset);
+		ar | obj;
+		return ar.size();
+	}
+}
+
+// makes room for 'obj' in the archive's buffer so writing it does not reallocate
+template<class T>
+void reserve_for(archive_vector_out& ar, T const& obj)
+{
+	ar.data.reserve(ar.data.size() + encoded_size(obj, ar.version_flags(), ar.offset()));
+}
+
 template<class ArchiveT, class T>
 inline typename is_archive_if<ArchiveT>::type&
 operator& (ArchiveT& ar, T const& obj)
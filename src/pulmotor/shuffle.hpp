@@ -0,0 +1,99 @@
+#ifndef PULMOTOR_SHUFFLE_HPP_
+#define PULMOTOR_SHUFFLE_HPP_
+
+#include "std/vector.hpp"
+
+namespace pulmotor {
+
+// Byte shuffle of 'count' values of S bytes: byte k of value i goes to dst[k * count + i], so that the
+// bytes that change little (exponents, high bytes of integers) end up next to each other. Done in tiles
+// so the S planes are written sequentially without going through the source S times.
+template<size_t S>
+void shuffle_bytes(void const* src, size_t count, void* dst)
+{
+	u8 const* s = (u8 const*)src;
+	u8* d = (u8*)dst;
+	enum : size_t { tile = 1024 };
+	for (size_t at=0; at<count; at+=tile) {
+		size_t n = std::min<size_t>(tile, count - at);
+		for (size_t k=0; k<S; ++k) {
+			u8 const* sk = s + at * S + k;
+			u8* dk = d + k * count + at;
+			for (size_t i=0; i<n; ++i)
+				dk[i] = sk[i * S];
+		}
+	}
+}
+
+template<size_t S>
+void unshuffle_bytes(void const* src, size_t count, void* dst)
+{
+	u8 const* s = (u8 const*)src;
+	u8* d = (u8*)dst;
+	enum : size_t { tile = 1024 };
+	for (size_t at=0; at<count; at+=tile) {
+		size_t n = std::min<size_t>(tile, count - at);
+		for (size_t k=0; k<S; ++k) {
+			u8 const* sk = s + k * count + at;
+			u8* dk = d + at * S + k;
+			for (size_t i=0; i<n; ++i)
+				dk[i * S] = sk[i];
+		}
+	}
+}
+
+// shuffled(v) stores a vector of primitives (or memory images) byte shuffled, as a filter in front of a
+// general purpose compressor applied to the archive or the file:
+//
+//   [u64 count] [byte 0 of every value] [byte 1 of every value] ...
+//
+// The size is the same as the plain array.
+template<class T, class C>
+struct shuffled_array_t
+{
+	enum { version = pulmotor::no_version };
+
+	static_assert(is_contiguous_element<T>::value, "shuffled() is for arrays of primitives or memory images");
+
+	C* c;
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		u64 count = c->size();
+		ar.align_stream(sizeof count);
+		ar.write_basic(count);
+
+		std::vector<u8> planes(count * sizeof(T));
+		shuffle_bytes<sizeof(T)>(c->data(), count, planes.data());
+		ar.write_transient(planes.data(), planes.size());
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 count;
+		ar.align_stream(sizeof count);
+		ar.read_basic(count);
+
+		c->clear();
+		adopt_memory_resource(ar, *c);
+		c->resize(count);
+
+		if constexpr(can_borrow<Ar>::value) {
+			unshuffle_bytes<sizeof(T)>(ar.borrow_data(count * sizeof(T)), count, c->data());
+		} else {
+			std::vector<u8> planes(count * sizeof(T));
+			ar.read_data(planes.data(), planes.size());
+			unshuffle_bytes<sizeof(T)>(planes.data(), count, c->data());
+		}
+	}
+};
+
+template<class T, class Al>
+shuffled_array_t<T, std::vector<T, Al>> shuffled(std::vector<T, Al>& v)
+{
+	return shuffled_array_t<T, std::vector<T, Al>> { &v };
+}
+
+} // pulmotor
+
+#endif // PULMOTOR_SHUFFLE_HPP_
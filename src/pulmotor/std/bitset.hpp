@@ -0,0 +1,38 @@
+#ifndef PULMOTOR_STD_BITSET_HPP_
+#define PULMOTOR_STD_BITSET_HPP_
+
+#include "../serialize.hpp"
+#include <bitset>
+
+namespace pulmotor
+{
+
+template<size_t N> struct class_version<std::bitset<N>> { static unsigned const value = pulmotor::no_version; };
+
+// stored as the (N+7)/8 bytes of its bits, lowest bits first. std::bitset keeps bit i in bit i % W of word
+// i / W (libstdc++, libc++ and MSVC alike), so on little endian targets the leading bytes of the object are
+// the stored bytes and whole words are copied.
+template<size_t N>
+inline constexpr bool bitset_is_word_array = std::is_trivially_copyable<std::bitset<N>>::value && sizeof(std::bitset<N>) >= (N + 7) / 8;
+
+template<class Ar, size_t N>
+void serialize_save(Ar& ar, std::bitset<N>& b, unsigned version)
+{
+	static_assert(bitset_is_word_array<N>, "unexpected std::bitset layout");
+	ar.write_transient(&b, (N + 7) / 8);
+}
+
+template<class Ar, size_t N>
+void serialize_load(Ar& ar, std::bitset<N>& b, unsigned version)
+{
+	static_assert(bitset_is_word_array<N>, "unexpected std::bitset layout");
+	b.reset();
+	ar.read_data(&b, (N + 7) / 8);
+	// bits past N in the last byte must stay clear
+	if constexpr(N % 8 != 0)
+		b &= std::bitset<N>().set();
+}
+
+}
+
+#endif // PULMOTOR_STD_BITSET_HPP_
@@ -3,6 +3,7 @@
 
 #include "../serialize.hpp"
 #include "utility.hpp"
+#include "memory_resource.hpp"
 
 namespace pulmotor {
 
@@ -12,9 +13,10 @@ void serialize(Ar& ar, std::map<K, T, C, Al>& m, unsigned version) {
 	using map_t = std::map<K, T, C, Al>;
 	u32 sz;
 
-	if constexpr(Ar::is_reading)
+	if constexpr(Ar::is_reading) {
 		m.clear();
-	else
+		adopt_memory_resource(ar, m);
+	} else
 		sz = m.size();
 
 	ar | sz;
@@ -22,13 +24,13 @@ void serialize(Ar& ar, std::map<K, T, C, Al>& m, unsigned version) {
 	if constexpr(Ar::is_reading) {
 		for (size_t i=0; i<sz; ++i) {
 			if constexpr(pulmotor::wants_construct<Ar, T>::value) {
-				typename map_t::key_type k;
+				auto k = make_loadable<typename map_t::key_type>(m.get_allocator());
 				ar | k;
 				ar | pulmotor::construct<T>( [&m, &k](auto&&... args) { m.emplace(k, args...); });
 			} else {
-				typename map_t::value_type v;
+				auto v = make_loadable<typename map_t::value_type>(m.get_allocator());
 				ar | v;
-				m.insert(v);
+				m.insert(std::move(v));
 			}
 		}
 	} else {
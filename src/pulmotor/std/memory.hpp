@@ -13,7 +13,12 @@ inline void serialize_load(Ar& ar, std::unique_ptr<T, D>& p)
 {
     using Tb = typename std::remove_const<T>::type;
     Tb* r = nullptr;
-    ar | r;
+    if constexpr(std::is_same<D, std::default_delete<T>>::value) {
+        // the deleter will call delete, so the object must not come from the archive's memory resource
+        scoped_memory_resource<Ar> no_resource(ar, nullptr);
+        ar | r;
+    } else
+        ar | r;
     p.reset(r);
 }
 
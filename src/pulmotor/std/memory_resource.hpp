@@ -0,0 +1,46 @@
+#ifndef PULMOTOR_STD_MEMORY_RESOURCE_HPP_
+#define PULMOTOR_STD_MEMORY_RESOURCE_HPP_
+
+#include <memory>
+#include <memory_resource>
+
+#include "../serialize.hpp"
+
+namespace pulmotor {
+
+template<class T>	struct is_polymorphic_allocator										: std::false_type {};
+template<class T>	struct is_polymorphic_allocator<std::pmr::polymorphic_allocator<T>>	: std::true_type {};
+
+// when the archive carries a memory resource and a pmr container being loaded still uses the default one,
+// rebuild the container with the archive's resource. everything loaded into it afterwards (elements, nested
+// pmr strings and containers) then allocates from that resource through uses-allocator construction.
+// containers that were given a resource explicitly are left alone. ordered containers keep their comparator.
+template<class Ar, class C>
+inline void adopt_memory_resource(Ar& ar, C& c)
+{
+	if constexpr(is_polymorphic_allocator<typename C::allocator_type>::value) {
+		std::pmr::memory_resource* r = ar.memory_resource();
+		std::pmr::memory_resource* cr = c.get_allocator().resource();
+		if (r && cr != r && cr == std::pmr::get_default_resource()) {
+			if constexpr(requires { c.key_comp(); }) {
+				auto comp = c.key_comp();
+				std::destroy_at(&c);
+				::new ((void*)&c) C(std::move(comp), typename C::allocator_type(r));
+			} else {
+				std::destroy_at(&c);
+				::new ((void*)&c) C(typename C::allocator_type(r));
+			}
+		}
+	}
+}
+
+// default-constructs a value to load into, using the container's allocator when T is allocator-aware
+template<class T, class Al>
+inline T make_loadable(Al const& al)
+{
+	return std::make_obj_using_allocator<T>(al);
+}
+
+} // pulmotor
+
+#endif // PULMOTOR_STD_MEMORY_RESOURCE_HPP_
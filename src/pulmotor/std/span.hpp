@@ -0,0 +1,39 @@
+#ifndef PULMOTOR_STD_SPAN_HPP_
+#define PULMOTOR_STD_SPAN_HPP_
+
+#include "../serialize.hpp"
+#include <span>
+
+namespace pulmotor
+{
+
+// a span of primitives is stored like std::vector of the same primitives, so either can be loaded from
+// what the other wrote. loading points the span into the source data, which must outlive it.
+template<class Ar, class T>
+void serialize_save(Ar& ar, std::span<T const>& s, unsigned version)
+{
+	static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "only spans of primitive types are supported");
+
+	u32 sz = s.size();
+	ar | sz;
+	if (sz)
+		ar | array(s.data(), sz);
+}
+
+template<class Ar, class T>
+void serialize_load(Ar& ar, std::span<T const>& s, unsigned version)
+{
+	static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "only spans of primitive types are supported");
+
+	u32 sz;
+	ar | sz;
+
+	if (sz)
+		s = std::span<T const>(logic<T>::s_borrowed_array(ar, sz), sz);
+	else
+		s = std::span<T const>();
+}
+
+}
+
+#endif // PULMOTOR_STD_SPAN_HPP_
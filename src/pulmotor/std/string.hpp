@@ -2,6 +2,8 @@
 #define PULMOTOR_STD_STRING_HPP_
 
 #include "../serialize.hpp"
+#include "memory_resource.hpp"
+#include "../string_table.hpp"
 #include <string>
 
 namespace pulmotor
@@ -12,6 +14,12 @@ template<class Ch, class Tr, class Al> struct class_version<std::basic_string<Ch
 template<class Ar, class Ch, class Tr, class Al>
 void serialize_save(Ar& ar, std::basic_string<Ch, Tr, Al>& s, unsigned version)
 {
+	if constexpr(std::is_same<Ch, char>::value)
+		if (string_table* t = ar.strings()) {
+			t->save(ar, std::string_view(s.data(), s.size()));
+			return;
+		}
+
 	u32 sz = s.size();
 	ar | sz;
 	if (sz)
@@ -21,6 +29,15 @@ void serialize_save(Ar& ar, std::basic_string<Ch, Tr, Al>& s, unsigned version)
 template<class Ar, class Ch, class Tr, class Al>
 void serialize_load(Ar& ar, std::basic_string<Ch, Tr, Al>& s, unsigned version)
 {
+	adopt_memory_resource(ar, s);
+
+	if constexpr(std::is_same<Ch, char>::value)
+		if (string_table* t = ar.strings()) {
+			std::string_view v = t->load(ar);
+			s.assign(v.data(), v.size());
+			return;
+		}
+
 	u32 sz;
 	ar | sz;
 
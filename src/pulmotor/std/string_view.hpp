@@ -0,0 +1,82 @@
+#ifndef PULMOTOR_STD_STRING_VIEW_HPP_
+#define PULMOTOR_STD_STRING_VIEW_HPP_
+
+#include "../serialize.hpp"
+#include "../string_table.hpp"
+#include <string_view>
+
+namespace pulmotor
+{
+
+// stored exactly like std::basic_string, so either can be loaded from what the other wrote. loading
+// points the view into the source data, which must outlive it, and needs an archive that can borrow
+// (checked at compile time). with a string_table attached char views are written and loaded through the
+// table; interned(v) below loads such a view with any archive.
+template<class Ch, class Tr> struct class_version<std::basic_string_view<Ch, Tr>> { static unsigned const value = pulmotor::no_version; };
+
+template<class Ar, class Ch, class Tr>
+void serialize_save(Ar& ar, std::basic_string_view<Ch, Tr>& s, unsigned version)
+{
+	if constexpr(std::is_same<Ch, char>::value)
+		if (string_table* t = ar.strings()) {
+			t->save(ar, std::string_view(s.data(), s.size()));
+			return;
+		}
+
+	u32 sz = s.size();
+	ar | sz;
+	if (sz)
+		ar | array(s.data(), sz);
+}
+
+template<class Ar, class Ch, class Tr>
+void serialize_load(Ar& ar, std::basic_string_view<Ch, Tr>& s, unsigned version)
+{
+	static_assert(can_borrow<Ar>::value, "string_view can only be loaded from an archive that can borrow, use interned() to load it through a string_table");
+
+	if constexpr(std::is_same<Ch, char>::value)
+		if (string_table* t = ar.strings()) {
+			std::string_view v = t->load(ar);
+			s = std::basic_string_view<Ch, Tr>(v.data(), v.size());
+			return;
+		}
+
+	u32 sz;
+	ar | sz;
+	s = std::basic_string_view<Ch, Tr>();
+	if (sz)
+		s = std::basic_string_view<Ch, Tr>(logic<Ch>::s_borrowed_array(ar, sz), sz);
+}
+
+// interned(v) writes a char view like the view itself, and loads it from the string_table attached to the
+// archive, so the view points into the table and any archive can load it. an archive that cannot borrow
+// and has no table skips the string, leaves the view empty and sets errc::not_supported.
+struct interned_view_t
+{
+	enum { version = pulmotor::no_version };
+
+	std::string_view* s;
+
+	template<class Ar>
+	void serialize_save(Ar& ar) { ar | *s; }
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		if constexpr(can_borrow<Ar>::value)
+			ar | *s;
+		else if (string_table* t = ar.strings())
+			*s = t->load(ar);
+		else {
+			u32 sz;
+			ar | sz;
+			ar.advance(sz);
+			*s = std::string_view();
+			ar.data_error(std::errc::not_supported);
+		}
+	}
+};
+
+inline interned_view_t interned(std::string_view& s) { return interned_view_t { &s }; }
+}
+
+#endif // PULMOTOR_STD_STRING_VIEW_HPP_
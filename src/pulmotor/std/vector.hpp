@@ -1,13 +1,26 @@
+#ifndef PULMOTOR_STD_VECTOR_HPP_
+#define PULMOTOR_STD_VECTOR_HPP_
+
 #include "../serialize.hpp"
+#include "memory_resource.hpp"
+
+#include <bit>
 
 namespace pulmotor
 {
 
+// elements that are written back to back with the same alignment, so the whole vector is one block.
+// bool is excluded as vector<bool> has no data().
+template<class T>
+struct is_contiguous_element : std::integral_constant<bool,
+	((std::is_arithmetic<T>::value || std::is_enum<T>::value) && !std::is_same<T, bool>::value) || memory_image<T>::value> {};
+
 template<class Ar, class T, class Al>
 void serialize_load(Ar& ar, std::vector<T, Al>& v, unsigned version)
 {
 	u32 sz;
 	v.clear();
+	adopt_memory_resource(ar, v);
 
 	ar | sz;
 
@@ -18,9 +31,13 @@ void serialize_load(Ar& ar, std::vector<T, Al>& v, unsigned version)
 	} else {
 		v.resize(sz);
 
-		//ar | array(v.data(), v.size());
-		for (size_t i=0; i<sz; ++i)
-			ar | v[i];
+		// empty vectors take no alignment, same as the element by element encoding
+		if constexpr(is_contiguous_element<T>::value) {
+			if (sz)
+				ar | pulmotor::array(v.data(), v.size());
+		} else
+			for (size_t i=0; i<sz; ++i)
+				ar | v[i];
 	}
 }
 
@@ -33,11 +50,79 @@ void serialize_save(Ar& ar, std::vector<T, Al>& v, unsigned version)
 	if constexpr(wants_construct<Ar, T>::value) {
 		for (size_t i=0; i<sz; ++i)
 			ar | v[i];
+	} else if constexpr(is_contiguous_element<T>::value) {
+		if (sz)
+			ar | pulmotor::array(v.data(), v.size());
 	} else {
-		//ar | array(v.data(), v.size());
 		for (size_t i=0; i<sz; ++i)
 			ar | v[i];
 	}
 }
 
+// vector<bool> is stored as its size and the bits packed 8 to a byte, lowest bits first. libstdc++ keeps
+// the bits lowest first in words, so on a little endian machine the words are those bytes and are copied
+// whole. the standard gives no access to the words, other libraries go bit by bit.
+template<class Al>
+u8* bool_bytes(std::vector<bool, Al>& v)
+{
+#if defined(__GLIBCXX__)
+	if constexpr(std::endian::native == std::endian::little)
+		return v.empty() ? nullptr : reinterpret_cast<u8*>(v.begin()._M_p);
+#endif
+	return nullptr;
 }
+
+template<class Ar, class Al>
+void serialize_load(Ar& ar, std::vector<bool, Al>& v, unsigned version)
+{
+	u32 sz;
+	ar | sz;
+	v.clear();
+	adopt_memory_resource(ar, v);
+	v.assign(sz, false);
+
+	if (u8* bytes = bool_bytes(v)) {
+		ar.read_data(bytes, (sz + 7) / 8);
+		// bits past the end stay clear
+		if (sz & 7)
+			bytes[sz / 8] &= u8((1u << (sz & 7)) - 1);
+		return;
+	}
+
+	u8 block[512];
+	for (size_t at=0; at<sz; at+=sizeof block * 8) {
+		size_t n = std::min<size_t>(sz - at, sizeof block * 8);
+		ar.read_data(block, (n + 7) / 8);
+		for (size_t i=0; i<n; ++i)
+			v[at + i] = (block[i >> 3] >> (i & 7)) & 1;
+	}
+}
+
+template<class Ar, class Al>
+void serialize_save(Ar& ar, std::vector<bool, Al>& v, unsigned version)
+{
+	u32 sz = v.size();
+	ar | sz;
+
+	if (u8* bytes = bool_bytes(v)) {
+		if (sz / 8)
+			ar.write_data(bytes, sz / 8);
+		if (sz & 7) {
+			u8 last = bytes[sz / 8] & u8((1u << (sz & 7)) - 1);
+			ar.write_transient(&last, 1);
+		}
+		return;
+	}
+
+	u8 block[512];
+	for (size_t at=0; at<sz; at+=sizeof block * 8) {
+		size_t n = std::min<size_t>(sz - at, sizeof block * 8);
+		std::fill(std::begin(block), std::end(block), u8(0));
+		for (size_t i=0; i<n; ++i)
+			block[i >> 3] |= u8(v[at + i]) << (i & 7);
+		ar.write_transient(block, (n + 7) / 8);
+	}
+}
+}
+
+#endif // PULMOTOR_STD_VECTOR_HPP_
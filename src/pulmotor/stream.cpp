@@ -64,15 +64,101 @@ void sink_ostream::write(void const* data, size_t size, std::error_code& ec)
 	m_stream.write((char const*)data, size);
 }
 
+bool sink_ostream::can_rewrite()
+{
+	return m_stream.tellp() != std::ostream::pos_type(-1);
+}
+
+void sink_ostream::rewrite(size_t distance, void const* data, size_t size, std::error_code& ec)
+{
+	auto end = m_stream.tellp();
+	m_stream.seekp(end - std::streamoff(distance));
+	m_stream.write((char const*)data, size);
+	m_stream.seekp(end);
+	if (!m_stream)
+		ec = std::make_error_code(std::errc::io_error);
+}
+
 inline std::error_code mk_ec(int err) { return std::make_error_code((std::errc)err); }
 
+sink_file::~sink_file()
+{
+	if (m_fd != -1)
+		::close(m_fd);
+}
+
+void sink_file::open(path_char const* path, bool append, std::error_code& ec)
+{
+	assert(m_fd == -1);
+	if ((m_fd = ::open(path, O_WRONLY|O_CREAT|(append ? 0 : O_TRUNC), 0644)) == -1) {
+		ec=mk_ec(errno);
+		return;
+	}
+
+	struct stat st;
+	if (fstat(m_fd, &st) == -1) {
+		ec=mk_ec(errno);
+		::close(m_fd);
+		m_fd=-1;
+		return;
+	}
+	m_size=st.st_size;
+}
+
+void sink_file::close(std::error_code& ec)
+{
+	if (m_fd != -1 && ::close(m_fd) != 0)
+		ec=mk_ec(errno);
+	m_fd=-1;
+	m_size=0;
+}
+
+void sink_file::write(void const* data, size_t size, std::error_code& ec)
+{
+	char const* p = (char const*)data;
+	while (size) {
+		ssize_t w = pwrite(m_fd, p, size, m_size);
+		if (w == -1) {
+			if (errno == EINTR) continue;
+			ec=mk_ec(errno);
+			return;
+		}
+		p += w;
+		size -= w;
+		m_size += w;
+	}
+}
+
+void sink_file::rewrite(size_t distance, void const* data, size_t size, std::error_code& ec)
+{
+	assert(distance <= m_size && size <= distance);
+	if (pwrite(m_fd, data, size, m_size - distance) != (ssize_t)size)
+		ec=mk_ec(errno);
+}
+
+void sink_file::truncate(fs_t size, std::error_code& ec)
+{
+	if (ftruncate(m_fd, size) == -1) {
+		ec=mk_ec(errno);
+		return;
+	}
+	m_size=size;
+}
+
+void sink_file::sync(std::error_code& ec)
+{
+	if (fsync(m_fd) == -1)
+		ec=mk_ec(errno);
+}
+
 source_mmap::source_mmap()
 {
 	reset();
 }
 
-static int get_opfl(source_mmap::flags fl) { return fl==source_mmap::ro ? O_RDONLY : fl==source_mmap::wr ? O_WRONLY : O_RDWR; }
+static int get_opfl(source_mmap::flags fl) { return fl==source_mmap::ro || fl==source_mmap::cow ? O_RDONLY : fl==source_mmap::wr ? O_WRONLY : O_RDWR; }
 static int get_protfl(source_mmap::flags fl) { return fl==source_mmap::ro ? PROT_READ : fl==source_mmap::wr ? PROT_WRITE : (PROT_READ|PROT_WRITE); }
+static int get_mapfl(source_mmap::flags fl) { return fl==source_mmap::cow ? MAP_PRIVATE : MAP_SHARED; }
 
 source_mmap::~source_mmap()
 {
@@ -113,7 +199,7 @@ void source_mmap::map(path_char const* path, flags fl, std::error_code& ec, fs_t
 		blsz=m_filesize;
 
 	int protfl=get_protfl(fl);
-	if ((m_mmap = m_data = (char*)mmap(NULL, blsz, protfl, MAP_SHARED, m_fd, m_bloff)) == MAP_FAILED) {
+	if ((m_mmap = m_data = (char*)mmap(NULL, blsz, protfl, get_mapfl(fl), m_fd, m_bloff)) == MAP_FAILED) {
 		ec=mk_ec(errno);
 		close(m_fd);
 		reset();
@@ -162,7 +248,7 @@ void source_mmap::make_available(std::error_code& ec)
 	m_blsize = willMap;
 
 	if (willMap != 0) {
-		if ((m_mmap = m_data = (char*)mmap(NULL, willMap, get_protfl(m_flags), MAP_SHARED, m_fd, m_bloff)) == (void*)-1) {
+		if ((m_mmap = m_data = (char*)mmap(NULL, willMap, get_protfl(m_flags), get_mapfl(m_flags), m_fd, m_bloff)) == (void*)-1) {
 			ec=mk_ec(errno);
 			m_blsize=0;
 			return;
@@ -227,7 +313,7 @@ void source_buffer::make_available(std::error_code& ec)
 
 fs_t source_buffer::size()
 {
-	return m_blsize;
+	return m_bloff + m_blsize;
 }
 
 fs_t file_size (pulmotor::path_char const* file_name, std::error_code& ec)
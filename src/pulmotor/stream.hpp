@@ -48,12 +48,15 @@ public:
 	size_t fetch(void* dest, size_t sz, std::error_code& ec);
 
 	virtual fs_t size() = 0;
+	// whether the data can be modified in place (eg. a writable or copy-on-write mapping)
+	virtual bool writable() const { return false; }
 };
 
 class source_mmap : public source
 {
 public:
-	enum flags { ro, wr, rw };
+	// cow maps the file privately: the data can be modified but changes are not written back
+	enum flags { ro, wr, rw, cow };
 
 private:
 	void* m_mmap;
@@ -81,6 +84,7 @@ public:
 	void unmap(std::error_code& ec);
 
 	virtual fs_t size();
+	bool writable() const override { return m_flags != ro; }
 };
 
 class source_istream : public source
@@ -103,10 +107,11 @@ public:
 class source_buffer : public source
 {
 public:
-	source_buffer(char const* data, size_t data_size)
+	// 'base_offset' is the stream offset of 'data' (eg. when it is a block cut out of a larger stream)
+	source_buffer(char const* data, size_t data_size, fs_t base_offset = 0)
 	{
 		m_data = const_cast<char*>(data);
-		m_bloff = 0;
+		m_bloff = base_offset;
 		m_blsize = data_size;
 		m_cur = 0;
 	}
@@ -119,6 +124,11 @@ class sink
 {
 public:
 	virtual void write(void const* data, size_t size, std::error_code& ec) = 0;
+
+	// whether rewrite can be used
+	virtual bool can_rewrite() { return false; }
+	// overwrites 'size' bytes that were written 'distance' bytes before the current position
+	virtual void rewrite(size_t /*distance*/, void const* /*data*/, size_t /*size*/, std::error_code& ec) { ec = std::make_error_code(std::errc::not_supported); }
 };
 
 class sink_ostream : public sink
@@ -131,6 +141,41 @@ public:
 	~sink_ostream();
 
 	void write(void const* data, size_t size, std::error_code& ec);
+
+	bool can_rewrite() override;
+	void rewrite(size_t distance, void const* data, size_t size, std::error_code& ec) override;
+};
+
+// writes to a file through a posix descriptor, optionally appending to what is already there
+class sink_file : public sink
+{
+	int m_fd;
+	fs_t m_size;
+
+public:
+	sink_file() : m_fd(-1), m_size(0) {}
+	sink_file(path_char const* path, bool append, std::error_code& ec) : sink_file() { open(path, append, ec); }
+	~sink_file();
+
+	sink_file(sink_file const&) = delete;
+	sink_file& operator=(sink_file const&) = delete;
+
+	void open(path_char const* path, bool append, std::error_code& ec);
+	void close(std::error_code& ec);
+	bool is_open() const { return m_fd != -1; }
+
+	// file size, also the position of the next write
+	fs_t size() const { return m_size; }
+
+	void write(void const* data, size_t size, std::error_code& ec) override;
+
+	bool can_rewrite() override { return is_open(); }
+	void rewrite(size_t distance, void const* data, size_t size, std::error_code& ec) override;
+
+	// cuts the file at 'size', further writes continue from there
+	void truncate(fs_t size, std::error_code& ec);
+	// flushes written data to the storage device
+	void sync(std::error_code& ec);
 };
 
 struct PULMOTOR_ATTR_DLL header
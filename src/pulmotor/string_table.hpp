@@ -0,0 +1,95 @@
+#ifndef PULMOTOR_STRING_TABLE_HPP_
+#define PULMOTOR_STRING_TABLE_HPP_
+
+#include "serialize.hpp"
+
+#include <string_view>
+#include <unordered_map>
+#include <memory_resource>
+
+namespace pulmotor {
+
+// Strings shared by all char strings written through (or loaded from) an archive it is attached to with
+// set_string_table(). The first occurrence of a string is written in full, later ones as its index:
+//
+//   [vu ref]                  ref > 0: the ref-th distinct string
+//   [vu 0] [vu size] [chars]  a new string
+//
+// The loading side keeps one copy of every distinct string. std::string copies from it, std::string_view
+// points into it (interned() loads views this way with archives that cannot borrow), so equal strings
+// share storage that lives as long as the table. Writer and reader must attach a table at the same point
+// of the stream; clear() starts over, eg. between independent records. A reference to a string not loaded
+// yet fails the load with data_error().
+class string_table
+{
+	std::pmr::monotonic_buffer_resource m_chars;
+	std::unordered_map<std::string_view, u32> m_index;	// writing
+	std::vector<std::string_view> m_strings;			// reading
+	size_t m_refs = 0;
+
+	std::string_view store(char const* data, size_t size) {
+		char* p = static_cast<char*>(m_chars.allocate(size ? size : 1, 1));
+		memcpy(p, data, size);
+		return std::string_view(p, size);
+	}
+
+public:
+	string_table() = default;
+	string_table(string_table const&) = delete;
+	string_table& operator=(string_table const&) = delete;
+
+	template<class Ar>
+	void save(Ar& ar, std::string_view s) {
+		auto it = m_index.find(s);
+		if (it != m_index.end()) {
+			u32 ref = it->second + 1;
+			ar | vu<u8>(ref);
+			++m_refs;
+			return;
+		}
+
+		u32 ref = 0, size = u32(s.size());
+		ar | vu<u8>(ref) | vu<u8>(size);
+		if (size)
+			ar.write_data(s.data(), size);
+		m_index.emplace(store(s.data(), s.size()), u32(m_index.size()));
+	}
+
+	template<class Ar>
+	std::string_view load(Ar& ar) {
+		u32 ref = 0;
+		ar | vu<u8>(ref);
+		if (ref) {
+			if (ref > m_strings.size()) {
+				ar.data_error();
+				return std::string_view();
+			}
+			++m_refs;
+			return m_strings[ref - 1];
+		}
+
+		u32 size = 0;
+		ar | vu<u8>(size);
+		char* p = static_cast<char*>(m_chars.allocate(size ? size : 1, 1));
+		ar.read_data(p, size);
+		m_strings.emplace_back(p, size);
+		return m_strings.back();
+	}
+
+	// distinct strings written or loaded
+	size_t size() const { return m_index.size() + m_strings.size(); }
+	// occurrences written or loaded as a reference
+	size_t references() const { return m_refs; }
+
+	// forgets all strings, views handed out become invalid
+	void clear() {
+		m_index.clear();
+		m_strings.clear();
+		m_chars.release();
+		m_refs = 0;
+	}
+};
+
+} // pulmotor
+
+#endif // PULMOTOR_STRING_TABLE_HPP_
@@ -0,0 +1,154 @@
+#ifndef PULMOTOR_TIMESERIES_HPP_
+#define PULMOTOR_TIMESERIES_HPP_
+
+#include "serialize.hpp"
+#include "std/memory_resource.hpp"
+#include "bitstream.hpp"
+
+#include <bit>
+#include <cstring>
+
+namespace pulmotor {
+
+// timeseries(v) compresses a vector of float or double the way Gorilla does: every value is xor-ed with
+// the previous one, and only the bits that changed are kept:
+//
+//   [u64 count] [u64 word count] [u64 bit stream words]*
+//
+//   first value: all bits
+//   xor == 0:    '0'
+//   otherwise:   '1' '0' <changed bits>, when they fit the window of leading/trailing zeros of the
+//                previous value written this way
+//                '1' '1' [leading zeros: 5 bits] [changed bit count - 1: 5 (float) or 6 bits] <changed bits>
+//
+// Slowly changing values (gauges, counters stored as floating point) shrink to a few bits each. Values
+// round trip bit for bit, NaNs included.
+template<class T, class C>
+struct timeseries_t
+{
+	enum { version = pulmotor::no_version };
+
+	static_assert(std::is_same<T, float>::value || std::is_same<T, double>::value, "timeseries() is for float and double arrays");
+
+	using bits_t = std::conditional_t<sizeof(T) == 8, u64, u32>;
+	enum : unsigned { value_bits = sizeof(T) * 8, length_bits = sizeof(T) == 8 ? 6 : 5, max_leading = 31 };
+
+	C* c;
+
+	static bits_t to_bits(T v) { bits_t b; memcpy(&b, &v, sizeof b); return b; }
+	static T from_bits(bits_t b) { T v; memcpy(&v, &b, sizeof v); return v; }
+
+	static std::vector<u64>& encode(T const* data, size_t count, bit_writer& w) {
+		if (count) {
+			bits_t prev = to_bits(data[0]);
+			w.write(prev, value_bits);
+			unsigned lead = value_bits, trail = 0; // no window yet
+			for (size_t i=1; i<count; ++i) {
+				bits_t cur = to_bits(data[i]), x = cur ^ prev;
+				prev = cur;
+				if (x == 0) {
+					w.write_bit(0);
+					continue;
+				}
+
+				unsigned l = std::min<unsigned>(std::countl_zero(x), max_leading), t = std::countr_zero(x);
+				if (lead != value_bits && l >= lead && t >= trail) {
+					w.write(0b01, 2);
+					w.write(x >> trail, value_bits - lead - trail);
+				} else {
+					unsigned n = value_bits - l - t;
+					w.write(0b11, 2);
+					w.write(l, 5);
+					w.write(n - 1, length_bits);
+					w.write(x >> t, n);
+					lead = l;
+					trail = t;
+				}
+			}
+		}
+		return w.finish();
+	}
+
+	// false if the stream ends early or a window does not fit the value
+	static bool decode(u64 const* words, size_t nwords, T* out, size_t count) {
+		if (!count)
+			return true;
+
+		bit_reader r(words, nwords);
+		bits_t prev = bits_t(r.read(value_bits));
+		out[0] = from_bits(prev);
+		unsigned lead = 0, trail = 0;
+		for (size_t i=1; i<count; ++i) {
+			if (r.read_bit()) {
+				if (r.read_bit()) {
+					lead = unsigned(r.read(5));
+					unsigned n = unsigned(r.read(length_bits)) + 1;
+					if (lead + n > value_bits)
+						return false;
+					trail = value_bits - lead - n;
+				}
+				prev ^= bits_t(r.read(value_bits - lead - trail)) << trail;
+			}
+			if (r.overrun())
+				return false;
+			out[i] = from_bits(prev);
+		}
+		return !r.overrun();
+	}
+
+	template<class Ar>
+	void serialize_save(Ar& ar) {
+		bit_writer w;
+		std::vector<u64>& words = encode(c->data(), c->size(), w);
+
+		u64 count = c->size(), nwords = words.size();
+		ar.align_stream(sizeof count);
+		ar.write_basic(count);
+		ar.write_basic(nwords);
+		ar.write_transient(words.data(), nwords * sizeof(u64));
+	}
+
+	template<class Ar>
+	void serialize_load(Ar& ar) {
+		u64 count, nwords;
+		ar.align_stream(sizeof count);
+		ar.read_basic(count);
+		ar.read_basic(nwords);
+
+		// the first value takes value_bits, every later one at least one bit
+		c->clear();
+		u64 bits = nwords <= ~u64(0) / 64 ? nwords * 64 : ~u64(0);
+		if (count && (bits < value_bits || count - 1 > bits - value_bits)) {
+			ar.data_error();
+			return;
+		}
+
+		adopt_memory_resource(ar, *c);
+		c->resize(count);
+
+		u64 const* words;
+		std::vector<u64> owned;
+		if constexpr(can_borrow<Ar>::value)
+			words = reinterpret_cast<u64 const*>(ar.borrow_data(nwords * sizeof(u64)));
+		else {
+			owned.resize(nwords);
+			ar.read_data(owned.data(), nwords * sizeof(u64));
+			words = owned.data();
+		}
+
+		if (!decode(words, nwords, c->data(), count)) {
+			c->clear();
+			ar.data_error();
+		}
+	}
+};
+
+template<class T, class Al>
+timeseries_t<T, std::vector<T, Al>> timeseries(std::vector<T, Al>& v)
+{
+	return timeseries_t<T, std::vector<T, Al>> { &v };
+}
+
+} // pulmotor
+
+#endif // PULMOTOR_TIMESERIES_HPP_
@@ -25,6 +25,8 @@ int get_pagesize()
 		ps = si.dwPageSize;
 #elif defined(__APPLE__)
 		ps = getpagesize();
+#else
+		ps = sysconf(_SC_PAGESIZE);
 #endif
 	}
 	return ps;
@@ -108,6 +110,32 @@ bool duleb(size_t& s, int& state, u8 v) { return duleb_impl(s, state, v); }
 bool duleb(size_t& s, int& state, u16 v) { return duleb_impl(s, state, v); }
 bool duleb(size_t& s, int& state, u32 v) { return duleb_impl(s, state, v); }
 
+static u32 const* crc32c_table()
+{
+	static u32 table[256];
+	static bool init = [] {
+		for (u32 i=0; i<256; ++i) {
+			u32 c = i;
+			for (int k=0; k<8; ++k)
+				c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+			table[i] = c;
+		}
+		return true;
+	}();
+	(void)init;
+	return table;
+}
+
+u32 crc32c(void const* data, size_t size, u32 crc)
+{
+	u32 const* table = crc32c_table();
+	u8 const* p = (u8 const*)data;
+	crc = ~crc;
+	for (size_t i=0; i<size; ++i)
+		crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
 std::string dm (char const* a)
 {
 #if defined(__GNUC__) && 0
@@ -134,6 +134,9 @@ bool duleb(size_t& s, int& state, u8 v);
 bool duleb(size_t& s, int& state, u16 v);
 bool duleb(size_t& s, int& state, u32 v);
 
+// crc-32c (castagnoli), pass the previous result as 'crc' to continue a checksum
+u32 crc32c(void const* data, size_t size, u32 crc = 0);
+
 std::string dm (char const*);
 void hexdump (void const* p, int len);
 
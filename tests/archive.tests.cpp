@@ -423,3 +423,60 @@ TEST_CASE("size packing")
 		CHECK(TC(3, b) == ss);
 	}
 }
+
+TEST_CASE("pointer tracking")
+{
+	constexpr size_t N = 10000;
+	std::vector<int> objs(N);
+
+	SUBCASE("ptr id map")
+	{
+		ptr_id_map m;
+		CHECK(m.find(&objs[0]) == 0);
+
+		bool inserted = true;
+		for (size_t i=0; i<N; ++i)
+			inserted = inserted && m.insert(&objs[i], i + 1) == i + 1;
+		CHECK(inserted);
+		CHECK(m.size() == N);
+
+		// inserting again returns the original id
+		CHECK(m.insert(&objs[10], 12345) == 11);
+
+		bool all = true;
+		for (size_t i=0; i<N; ++i)
+			all = all && m.find(&objs[i]) == i + 1;
+		CHECK(all);
+		CHECK(m.find(&N) == 0);
+
+		size_t cap = m.capacity();
+		m.clear();
+		CHECK(m.size() == 0);
+		CHECK(m.capacity() == cap);
+		CHECK(m.find(&objs[0]) == 0);
+	}
+
+	SUBCASE("reset keeps ids dense")
+	{
+		archive_vector_out ar;
+		CHECK(ar.reg_ptr(&objs[0]) == 1);
+		CHECK(ar.reg_ptr(&objs[1]) == 2);
+		CHECK(ar.reg_ptr(&objs[0]) == 1);
+		CHECK(ar.lookup_id(&objs[1]) == 2);
+
+		ar.reset();
+		CHECK(ar.lookup_id(&objs[0]) == 0);
+		CHECK(ar.reg_ptr(&objs[1]) == 1);
+
+		archive_vector_in in(ar.data);
+		CHECK(in.restore_ptr(&objs[5]) == 1);
+		CHECK(in.restore_ptr(&objs[6]) == 2);
+		CHECK(in.lookup_ptr(2) == &objs[6]);
+		CHECK(in.lookup_ptr(3) == nullptr);
+		CHECK(in.lookup_ptr(0) == nullptr);
+
+		in.reset();
+		CHECK(in.lookup_ptr(1) == nullptr);
+		CHECK(in.restore_ptr(&objs[7]) == 1);
+	}
+}
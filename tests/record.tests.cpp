@@ -0,0 +1,494 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <pulmotor/record_index.hpp>
+#include <pulmotor/record_log.hpp>
+#include <pulmotor/parallel.hpp>
+#include <pulmotor/aligned.hpp>
+#include <pulmotor/std/string.hpp>
+#include <pulmotor/std/vector.hpp>
+
+#include <fstream>
+
+#define T_N "pulmotor.record.test.data"
+#define T_L "pulmotor.record.test.log"
+
+namespace record_types {
+
+struct R
+{
+	int id = 0;
+	std::string name;
+	std::vector<double> values;
+
+	template<class Ar>
+	void serialize(Ar& ar) {
+		ar | id | name | values;
+	}
+};
+
+struct P
+{
+	std::vector<float> samples;
+
+	template<class Ar>
+	void serialize(Ar& ar) {
+		ar | pulmotor::aligned(samples);
+	}
+};
+
+R make_record(int i)
+{
+	R r;
+	r.id = i;
+	r.name = "record " + std::to_string(i);
+	r.values.assign(i % 5, i * 0.5);
+	return r;
+}
+
+}
+
+TEST_CASE("record index")
+{
+	using namespace pulmotor;
+	using namespace record_types;
+
+	size_t const count = 100;
+
+	SUBCASE("memory")
+	{
+		archive_vector_out ar;
+		{
+			record_index_writer w(ar);
+			for (size_t i=0; i<count; ++i)
+				CHECK(w.write(make_record(i)) == i);
+		}
+
+		std::error_code ec;
+		record_index_reader rr(ar.data.data(), ar.data.size(), ec);
+		REQUIRE(!ec);
+		CHECK(rr.size() == count);
+		CHECK(!rr.has_keys());
+		CHECK(rr.offset(0) == 0);
+
+		for (size_t i : { 57, 3, 99, 0, 42 }) {
+			R r;
+			rr.read(i, r);
+			CHECK(r.id == int(i));
+			CHECK(r.name == make_record(i).name);
+			CHECK(r.values == make_record(i).values);
+		}
+	}
+
+	SUBCASE("keys")
+	{
+		archive_vector_out ar;
+		record_index_writer w(ar);
+		for (size_t i=0; i<count; ++i)
+			w.write(make_record(i), 1000 + i * 10);
+		w.close();
+
+		std::error_code ec;
+		record_index_reader rr(ar.data.data(), ar.data.size(), ec);
+		REQUIRE(!ec);
+		CHECK(rr.has_keys());
+		CHECK(rr.key(7) == 1070);
+		CHECK(rr.find(0) == 0);
+		CHECK(rr.find(1070) == 7);
+		CHECK(rr.find(1071) == 8);
+		CHECK(rr.find(5000) == count);
+
+		R r;
+		rr.read(rr.find(1500), r);
+		CHECK(r.id == 50);
+	}
+
+	SUBCASE("mapped file")
+	{
+		{
+			std::ofstream f(T_N, std::ios_base::binary|std::ios_base::trunc);
+			sink_ostream so(f);
+			archive_sink ar(so);
+			record_index_writer w(ar);
+			for (size_t i=0; i<count; ++i)
+				w.write(make_record(i));
+		}
+
+		std::error_code ec;
+		source_mmap sm(T_N, source_mmap::ro, ec);
+		REQUIRE(!ec);
+		record_index_reader rr(sm, ec);
+		REQUIRE(!ec);
+		CHECK(rr.size() == count);
+
+		R r;
+		rr.read(count - 1, r);
+		CHECK(r.id == count - 1);
+		rr.read(1, r);
+		CHECK(r.name == "record 1");
+	}
+
+	SUBCASE("bad trailer")
+	{
+		std::vector<char> junk(64, 'x');
+		std::error_code ec;
+		record_index_reader rr(junk.data(), junk.size(), ec);
+		CHECK(ec);
+
+		std::error_code ec2;
+		record_index_reader rr2(junk.data(), 8, ec2);
+		CHECK(ec2);
+	}
+
+	SUBCASE("bad index")
+	{
+		archive_vector_out ar;
+		{
+			record_index_writer w(ar);
+			for (size_t i=0; i<count; ++i)
+				w.write(make_record(i), i);
+		}
+
+		auto trailer = [](std::vector<char>& d) { return reinterpret_cast<record_trailer*>(d.data() + d.size() - sizeof(record_trailer)); };
+
+		// a count that does not fit into the index
+		std::vector<char> d = ar.data;
+		trailer(d)->count = u64(1) << 60;
+		std::error_code ec;
+		record_index_reader rr(d.data(), d.size(), ec);
+		CHECK(ec);
+		CHECK(rr.size() == 0);
+
+		d = ar.data;
+		trailer(d)->count = count + 1;
+		std::error_code ec1;
+		record_index_reader rr1(d.data(), d.size(), ec1);
+		CHECK(ec1);
+
+		// the first offset pointing past the index
+		d = ar.data;
+		char* first = d.data() + trailer(d)->index_offset;
+		first[0] = first[1] = char(0xff);
+		first[2] = 0x7f;
+		std::error_code ec2;
+		record_index_reader rr2(d.data(), d.size(), ec2);
+		CHECK(ec2);
+
+		d = ar.data;
+		std::error_code ec3;
+		record_index_reader rr3(d.data(), d.size(), ec3);
+		CHECK(!ec3);
+		CHECK(rr3.size() == count);
+	}
+}
+
+namespace record_types {
+
+void remove_log()
+{
+	for (unsigned n=0; std::remove(pulmotor::record_log_format::segment_path(T_L, n).c_str()) == 0; ++n)
+		;
+}
+
+std::vector<R> read_log(bool verify = true)
+{
+	using namespace pulmotor;
+
+	std::error_code ec;
+	record_log_reader log(T_L, ec, verify);
+	REQUIRE(!ec);
+
+	std::vector<R> rs;
+	for (auto it = log.begin(); it != log.end(); ++it) {
+		source_buffer sb = *it;
+		archive_whole ar(sb);
+		R r;
+		ar | r;
+		CHECK(it.sequence() == rs.size());
+		CHECK(ar.offset() == sb.size());
+		rs.push_back(std::move(r));
+	}
+	return rs;
+}
+
+}
+
+TEST_CASE("record log")
+{
+	using namespace pulmotor;
+	using namespace record_types;
+
+	remove_log();
+
+	size_t const count = 50;
+	{
+		std::error_code ec;
+		record_log_writer w(T_L, 1u << 20, ec);
+		REQUIRE(!ec);
+		for (size_t i=0; i<count; ++i)
+			CHECK(w.append(make_record(i), ec) == i);
+		CHECK(!ec);
+		CHECK(w.segment() == 0);
+	}
+
+	SUBCASE("read")
+	{
+		std::vector<R> rs = read_log();
+		REQUIRE(rs.size() == count);
+		CHECK(rs[17].name == "record 17");
+		CHECK(rs[49].values == make_record(49).values);
+	}
+
+	SUBCASE("reopen and append")
+	{
+		std::error_code ec;
+		record_log_writer w(T_L, 1u << 20, ec);
+		REQUIRE(!ec);
+		CHECK(w.truncated() == 0);
+		CHECK(w.next_sequence() == count);
+		CHECK(w.append(make_record(count), ec) == count);
+		w.close(ec);
+
+		CHECK(read_log().size() == count + 1);
+	}
+
+	SUBCASE("torn tail")
+	{
+		auto path = record_log_format::segment_path(T_L, 0);
+		fs_t size = file_size(path.c_str());
+		{
+			// half of the last record made it to the disk
+			std::error_code ec;
+			sink_file f(path.c_str(), true, ec);
+			f.truncate(size - 20, ec);
+			REQUIRE(!ec);
+		}
+		CHECK(read_log().size() == count - 1);
+
+		std::error_code ec;
+		record_log_writer w(T_L, 1u << 20, ec);
+		REQUIRE(!ec);
+		CHECK(w.truncated() > 0);
+		CHECK(w.next_sequence() == count - 1);
+		w.append(make_record(count - 1), ec);
+		w.close(ec);
+
+		std::vector<R> rs = read_log();
+		REQUIRE(rs.size() == count);
+		CHECK(rs.back().name == make_record(count - 1).name);
+	}
+
+	SUBCASE("corrupt payload")
+	{
+		auto path = record_log_format::segment_path(T_L, 0);
+		fs_t size = file_size(path.c_str());
+		{
+			std::error_code ec;
+			sink_file f(path.c_str(), true, ec);
+			char garbage = 0x55;
+			f.rewrite(8, &garbage, 1, ec);
+		}
+		CHECK(read_log().size() == count - 1);
+		CHECK(read_log(false).size() == count);
+		CHECK(file_size(path.c_str()) == size);
+	}
+
+	SUBCASE("segment rollover")
+	{
+		remove_log();
+
+		std::error_code ec;
+		{
+			record_log_writer w(T_L, 512, ec);
+			for (size_t i=0; i<count; ++i)
+				w.append(make_record(i), ec);
+			CHECK(!ec);
+			CHECK(w.segment() > 2);
+		}
+		for (unsigned n=0; file_size(record_log_format::segment_path(T_L, n).c_str()); ++n)
+			CHECK(file_size(record_log_format::segment_path(T_L, n).c_str()) <= 512);
+
+		record_log_reader log(T_L, ec);
+		CHECK(log.segment_count() > 2);
+
+		std::vector<R> rs = read_log();
+		REQUIRE(rs.size() == count);
+		for (size_t i=0; i<count; ++i)
+			CHECK(rs[i].id == int(i));
+
+		record_log_writer w(T_L, 512, ec);
+		CHECK(w.next_sequence() == count);
+	}
+
+	remove_log();
+}
+
+TEST_CASE("parallel read")
+{
+	using namespace pulmotor;
+	using namespace record_types;
+
+	SUBCASE("every item once")
+	{
+		size_t const count = 10000;
+		std::vector<std::atomic<int>> seen(count);
+		parallel_for(count, 8, [&](size_t i) {
+			// make the first items much more expensive than the rest
+			if (i < 8)
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			seen[i]++;
+		});
+		CHECK(std::all_of(seen.begin(), seen.end(), [](auto& s) { return s == 1; }));
+
+		parallel_for(0, 4, [&](size_t i) { seen[i]++; });
+		parallel_for(3, 0, [&](size_t i) { seen[i]++; });
+		CHECK(seen[2] == 2);
+		CHECK(seen[3] == 1);
+	}
+
+	SUBCASE("records in order")
+	{
+		size_t const count = 1000;
+		archive_vector_out ar;
+		{
+			record_index_writer w(ar);
+			for (size_t i=0; i<count; ++i)
+				w.write(make_record(i));
+		}
+
+		std::error_code ec;
+		record_index_reader rr(ar.data.data(), ar.data.size(), ec);
+		REQUIRE(!ec);
+
+		std::vector<R> rs;
+		parallel_read(rr, rs, 4);
+		REQUIRE(rs.size() == count);
+		bool ok = true;
+		for (size_t i=0; i<count; ++i)
+			ok = ok && rs[i].id == int(i) && rs[i].values == make_record(i).values;
+		CHECK(ok);
+	}
+
+	SUBCASE("exception")
+	{
+		CHECK_THROWS(parallel_for(100, 4, [](size_t i) { if (i == 50) throw std::runtime_error("x"); }));
+	}
+}
+
+TEST_CASE("parallel vector")
+{
+	using namespace pulmotor;
+	using namespace record_types;
+
+	std::vector<R> v;
+	for (size_t i=0; i<1000; ++i)
+		v.push_back(make_record(i));
+
+	auto check = [&v](std::vector<R> const& l) {
+		REQUIRE(l.size() == v.size());
+		bool ok = true;
+		for (size_t i=0; i<v.size(); ++i)
+			ok = ok && l[i].id == v[i].id && l[i].name == v[i].name && l[i].values == v[i].values;
+		CHECK(ok);
+	};
+
+	for (size_t chunk : { 0, 1, 7, 333, 5000 }) {
+		archive_vector_out ar;
+		int before = 1, after = 2;
+		ar | before | parallel(v, 4, chunk) | after;
+		// chunks start at offsets aligned for any object
+		CHECK(ar.data.size() > 256);
+
+		archive_vector_in in(ar.data);
+		std::vector<R> l;
+		int x = 0, y = 0;
+		in | x | parallel(l, 3) | y;
+		CHECK(x == before);
+		CHECK(y == after);
+		check(l);
+
+		source_buffer sb(ar.data.data(), ar.data.size());
+		archive_whole aw(sb);
+		std::vector<R> l2;
+		aw | x | parallel(l2) | y;
+		CHECK(y == after);
+		check(l2);
+	}
+
+	SUBCASE("same alignment as serial encoding")
+	{
+		archive_vector_out ar(ver_flag_align_object);
+		char c = 'x';
+		size_t const per_chunk = 10;
+		ar | c | parallel(v, 2, per_chunk);
+
+		// walk the header to the chunks
+		archive_vector_in h(ar.data);
+		u64 count, chunk_align;
+		u32 chunks, pc;
+		h | c;
+		h.align_stream(sizeof count);
+		h | count | chunks | pc | chunk_align;
+		REQUIRE(pc == per_chunk);
+		CHECK(chunk_align == 256);
+		std::vector<u64> sizes(chunks);
+		for (u64& s : sizes)
+			h | s;
+
+		// every chunk holds the bytes its elements have when written by themselves from a 256 byte boundary
+		bool same = true, aligned = true;
+		for (u32 i=0; i<chunks; ++i) {
+			h.align_stream(chunk_align);
+			aligned = aligned && h.offset() % 256 == 0;
+
+			archive_vector_out serial(ver_flag_align_object);
+			for (size_t e=i * per_chunk; e<std::min<size_t>(v.size(), (i + 1) * per_chunk); ++e)
+				serial | v[e];
+			same = same && serial.data.size() == sizes[i] && memcmp(serial.data.data(), ar.data.data() + h.offset(), sizes[i]) == 0;
+			h.advance(sizes[i]);
+		}
+		CHECK(aligned);
+		CHECK(same);
+		CHECK(h.offset() == ar.data.size());
+
+		archive_vector_in in(ar.data);
+		std::vector<R> l;
+		in | c | parallel(l);
+		check(l);
+	}
+
+	SUBCASE("page aligned elements")
+	{
+		std::vector<P> pv(5);
+		for (size_t i=0; i<pv.size(); ++i)
+			pv[i].samples.assign(4096, float(i));
+
+		archive_vector_out ar;
+		char c = 'x';
+		ar | c | parallel(pv, 2, 2);
+
+		archive_vector_in h(ar.data);
+		u64 count, chunk_align;
+		u32 chunks, pc;
+		h | c;
+		h.align_stream(sizeof count);
+		h | count | chunks | pc | chunk_align;
+		CHECK(chunk_align == u64(util::get_pagesize()));
+
+		archive_vector_in in(ar.data);
+		std::vector<P> l;
+		in | c | parallel(l, 3);
+		REQUIRE(l.size() == pv.size());
+		CHECK(l[4].samples == pv[4].samples);
+	}
+
+	SUBCASE("empty")
+	{
+		std::vector<R> e, l(3);
+		archive_vector_out ar;
+		ar | parallel(e);
+		archive_vector_in in(ar.data);
+		in | parallel(l);
+		CHECK(l.empty());
+	}
+}
@@ -70,6 +70,36 @@ doctest::String toString(std::map<K, T, C, A> const& m) {
 
 } // std
 
+// writes wrap(v) between two markers and loads it back through archive_vector_in and archive_whole, the
+// loaded elements must match bit for bit (NaNs included). returns the number of bytes written.
+template<class V, class Wrap>
+size_t round_trip(V& v, Wrap wrap)
+{
+	using namespace pulmotor;
+
+	archive_vector_out ar;
+	char c = 'x';
+	ar | c | wrap(v) | c;
+
+	auto same = [&v](V const& l) {
+		return l.size() == v.size() && (v.empty() || memcmp(l.data(), v.data(), v.size() * sizeof(v[0])) == 0);
+	};
+
+	V l(3), l2;
+	archive_vector_in in(ar.data);
+	char c1 = 0, c2 = 0;
+	in | c1 | wrap(l) | c2;
+	CHECK(c2 == 'x');
+	CHECK(same(l));
+
+	source_buffer sb(ar.data.data(), ar.data.size());
+	archive_whole aw(sb);
+	aw | c1 | wrap(l2) | c2;
+	CHECK(c2 == 'x');
+	CHECK(same(l2));
+	return ar.data.size();
+}
+
 template<class T>
 struct basic_tester {
 	void operator()(T value) {
@@ -879,6 +909,204 @@ TEST_CASE("ptr serialize")
 #endif
 }
 
+namespace graph_types
+{
+	struct X
+	{
+		int x;
+		int data[8]{};
+		template<class Ar> void serialize(Ar& ar) { ar | x | data; }
+	};
+
+	struct S
+	{
+		X* a{nullptr};
+		X* b{nullptr};
+		template<class Ar> void serialize(Ar& ar) { ar | a | b; }
+	};
+
+	struct N
+	{
+		int v{0};
+		N* next{nullptr};
+		template<class Ar> void serialize(Ar& ar) { ar | v | next; }
+	};
+}
+
+TEST_CASE("shared ptr serialize")
+{
+	using namespace graph_types;
+	using namespace pulmotor;
+	archive_vector_out ar;
+
+	SUBCASE("same object twice")
+	{
+		X x{0x1234}, y{0x1234};
+		S s{&x, &x};
+		ar | s;
+
+		archive_vector_out distinct;
+		distinct | S{&x, &y};
+		CHECK(ar.data.size() < distinct.data.size());
+
+		S z;
+		archive_vector_in i(ar.data);
+		i | z;
+		REQUIRE(z.a != nullptr);
+		CHECK(z.a == z.b);
+		CHECK(z.a->x == x.x);
+		delete z.a;
+	}
+
+	SUBCASE("shared across top level objects")
+	{
+		X x{7}, y{8};
+		S s1{&x, &y}, s2{&y, &x};
+		ar | s1 | s2;
+
+		S z1, z2;
+		archive_vector_in i(ar.data);
+		i | z1 | z2;
+		CHECK(z1.a == z2.b);
+		CHECK(z1.b == z2.a);
+		CHECK(z1.a->x == 7);
+		CHECK(z1.b->x == 8);
+		delete z1.a;
+		delete z1.b;
+	}
+
+	SUBCASE("cycle")
+	{
+		N n1, n2, n3;
+		n1.v = 1; n1.next = &n2;
+		n2.v = 2; n2.next = &n3;
+		n3.v = 3; n3.next = &n1;
+		N* root = &n1;
+		ar | root;
+
+		N* r = nullptr;
+		archive_vector_in i(ar.data);
+		i | r;
+		REQUIRE(r != nullptr);
+		CHECK(r->v == 1);
+		CHECK(r->next->v == 2);
+		CHECK(r->next->next->v == 3);
+		CHECK(r->next->next->next == r);
+		delete r->next->next;
+		delete r->next;
+		delete r;
+	}
+
+	SUBCASE("self reference")
+	{
+		N n;
+		n.v = 10;
+		n.next = &n;
+		N* root = &n;
+		ar | root;
+
+		std::stringstream ss;
+		sink_ostream so(ss);
+		archive_sink sar(so);
+		sar | root;
+
+		N* r = nullptr;
+		archive_vector_in i(ar.data);
+		i | r;
+		REQUIRE(r != nullptr);
+		CHECK(r->next == r);
+		CHECK(r->v == 10);
+		delete r;
+
+		std::string str = ss.str();
+		source_buffer sb(str.data(), str.size());
+		archive_whole w(sb);
+		N* rw = nullptr;
+		w | rw;
+		REQUIRE(rw != nullptr);
+		CHECK(rw->next == rw);
+		delete rw;
+	}
+}
+
+namespace resource_types
+{
+	struct counting_resource : std::pmr::memory_resource
+	{
+		std::pmr::memory_resource* upstream;
+		size_t allocs = 0, deallocs = 0;
+
+		explicit counting_resource(std::pmr::memory_resource* up) : upstream(up) {}
+
+		void* do_allocate(size_t bytes, size_t align) override { ++allocs; return upstream->allocate(bytes, align); }
+		void do_deallocate(void* p, size_t bytes, size_t align) override { ++deallocs; upstream->deallocate(p, bytes, align); }
+		bool do_is_equal(std::pmr::memory_resource const& o) const noexcept override { return this == &o; }
+	};
+
+	struct ordered_by
+	{
+		bool descending = false;
+		bool operator()(int a, int b) const { return descending ? b < a : a < b; }
+	};
+}
+
+TEST_CASE("ptr serialize with memory resource")
+{
+	using namespace graph_types;
+	using namespace resource_types;
+	using namespace pulmotor;
+	archive_vector_out ar;
+
+	constexpr size_t count_N = 1000;
+	std::vector<N> nodes(count_N);
+	for (size_t i=0; i<count_N; ++i) {
+		nodes[i].v = i;
+		nodes[i].next = i + 1 < count_N ? &nodes[i+1] : nullptr;
+	}
+	N* root = &nodes[0];
+	ar | root;
+
+	char buffer[count_N * sizeof(N) + 1024];
+	std::pmr::monotonic_buffer_resource arena(buffer, sizeof buffer, std::pmr::null_memory_resource());
+	counting_resource counting(&arena);
+
+	archive_vector_in i(ar.data);
+	i.set_memory_resource(&counting);
+
+	N* r = nullptr;
+	i | r;
+	CHECK(counting.allocs == count_N);
+
+	size_t count = 0;
+	bool in_arena = true, values = true;
+	for (N* p = r; p; p = p->next, ++count) {
+		in_arena = in_arena && (char*)p >= buffer && (char*)p < buffer + sizeof buffer;
+		values = values && p->v == count;
+	}
+	CHECK(count == count_N);
+	CHECK(in_arena);
+	CHECK(values);
+
+	SUBCASE("overwrite with null returns memory to the resource")
+	{
+		archive_vector_out nar;
+		N* null_node = nullptr;
+		nar | null_node;
+
+		archive_vector_in ni(nar.data);
+		ni.set_memory_resource(&counting);
+		N* last = r;
+		while (last->next->next)
+			last = last->next;
+		ni | last->next;
+		CHECK(last->next == nullptr);
+		CHECK(counting.deallocs == 1);
+	}
+
+	// the whole graph goes away at once
+	arena.release();
+}
+
 namespace loadsave_types
 {
 
@@ -1283,3 +1511,1662 @@ TEST_CASE("map")
 
 
 
+
+TEST_CASE("pmr containers")
+{
+	using namespace pulmotor;
+	using namespace resource_types;
+
+	archive_vector_out ar;
+
+	std::pmr::monotonic_buffer_resource arena;
+	counting_resource counting(&arena);
+
+	std::pmr::vector<std::pmr::string> v{ "a string that is too long for small string optimization", "short", "" };
+	std::pmr::map<std::pmr::string, std::pmr::vector<int>> m{ { "the first key, also long enough to allocate", {1, 2, 3} }, { "k", {} } };
+	ar | v | m;
+
+	archive_vector_in i(ar.data);
+	i.set_memory_resource(&counting);
+
+	SUBCASE("loaded containers use archive resource")
+	{
+		std::pmr::vector<std::pmr::string> xv;
+		std::pmr::map<std::pmr::string, std::pmr::vector<int>> xm;
+		i | xv | xm;
+
+		CHECK(xv == v);
+		CHECK(xm == m);
+		CHECK(xv.get_allocator().resource() == &counting);
+		CHECK(xv[0].get_allocator().resource() == &counting);
+		CHECK(xm.get_allocator().resource() == &counting);
+		CHECK(xm.begin()->first.get_allocator().resource() == &counting);
+		CHECK(xm.begin()->second.get_allocator().resource() == &counting);
+		CHECK(counting.allocs > 0);
+	}
+
+	SUBCASE("vector<bool> uses archive resource")
+	{
+		std::pmr::vector<bool> b(300);
+		b[1] = b[299] = true;
+		archive_vector_out bo;
+		bo | b;
+
+		archive_vector_in bi(bo.data);
+		bi.set_memory_resource(&counting);
+		std::pmr::vector<bool> xb;
+		bi | xb;
+		CHECK(xb == b);
+		CHECK(xb.get_allocator().resource() == &counting);
+	}
+
+	SUBCASE("explicit resource is kept")
+	{
+		std::pmr::monotonic_buffer_resource own;
+		std::pmr::vector<std::pmr::string> xv(&own);
+		i | xv;
+
+		CHECK(xv == v);
+		CHECK(xv.get_allocator().resource() == &own);
+		CHECK(xv[0].get_allocator().resource() == &own);
+	}
+
+	SUBCASE("map comparator is kept")
+	{
+		using map_t = std::map<int, int, ordered_by, std::pmr::polymorphic_allocator<std::pair<int const, int>>>;
+		map_t dm(ordered_by { true });
+		dm[1] = 10; dm[3] = 30; dm[2] = 20;
+
+		archive_vector_out mo;
+		mo | dm;
+		archive_vector_in mi(mo.data);
+		mi.set_memory_resource(&counting);
+
+		map_t xm(ordered_by { true });
+		mi | xm;
+		CHECK(xm.get_allocator().resource() == &counting);
+		CHECK(xm.key_comp().descending == true);
+		CHECK(xm.begin()->first == 3);
+		CHECK(xm == dm);
+	}
+}
+
+#include <pulmotor/std/string_view.hpp>
+#include <pulmotor/std/span.hpp>
+namespace borrow_types
+{
+	struct H { int id; float w[3]; };
+
+	struct D
+	{
+		std::string_view name;
+		std::span<int const> ids;
+		pulmotor::borrowed<H> header;
+
+		template<class Ar> void serialize(Ar& ar) { ar | name | ids | header; }
+	};
+}
+
+TEST_CASE("borrowed views")
+{
+	using namespace pulmotor;
+	using namespace borrow_types;
+
+	CHECK(can_borrow<archive_whole>::value == true);
+	CHECK(can_borrow<archive_vector_in>::value == false);
+	CHECK(can_borrow<archive_chunked>::value == false);
+
+	archive_vector_out ar;
+
+	std::string name("some name that lives in the archive");
+	std::vector<int> ids{1, 2, 3, 5, 8, 13};
+	H h{42, {1.f, 2.f, 3.f}};
+
+	SUBCASE("point into source")
+	{
+		D d{name, ids, borrowed<H>(&h)};
+		ar | d;
+
+		source_buffer sb(ar.data.data(), ar.data.size());
+		archive_whole w(sb);
+		D x;
+		w | x;
+
+		char const* b = ar.data.data(), *e = b + ar.data.size();
+		CHECK(x.name == name);
+		CHECK(x.name.data() >= b);
+		CHECK(x.name.data() < e);
+		CHECK(std::equal(x.ids.begin(), x.ids.end(), ids.begin(), ids.end()));
+		CHECK((char const*)x.ids.data() >= b);
+		CHECK((char const*)x.ids.data() < e);
+		CHECK(x.header->id == 42);
+		CHECK(x.header->w[2] == 3.f);
+		CHECK((char const*)x.header.get() >= b);
+		CHECK((char const*)x.header.get() < e);
+		CHECK(w.offset() == ar.data.size());
+	}
+
+	SUBCASE("compatible with owning types")
+	{
+		std::string_view empty;
+		ar | name | ids | empty;
+
+		source_buffer sb(ar.data.data(), ar.data.size());
+		archive_whole w(sb);
+		std::string_view xn, xe("x");
+		std::span<int const> xi;
+		w | xn | xi | xe;
+		CHECK(xn == name);
+		CHECK(std::equal(xi.begin(), xi.end(), ids.begin(), ids.end()));
+		CHECK(xe.empty());
+
+		std::string_view nv(name);
+		std::span<int const> iv(ids);
+		archive_vector_out ar2;
+		ar2 | nv | iv | empty;
+		CHECK(ar2.data == ar.data);
+	}
+}
+
+#include <pulmotor/lazy.hpp>
+namespace lazy_types
+{
+	struct Big
+	{
+		std::vector<int> values;
+		std::string name;
+		pulmotor::u64 tail = 0;
+		template<class Ar> void serialize(Ar& ar) { ar | values | name | tail; }
+	};
+
+	struct Config
+	{
+		int head = 0;
+		pulmotor::lazy<Big> big;
+		pulmotor::lazy<ptr_types::A> ctor;
+		pulmotor::u16 last = 0;
+		template<class Ar> void serialize(Ar& ar) { ar | head | big | ctor | last; }
+	};
+}
+
+TEST_CASE("lazy")
+{
+	using namespace pulmotor;
+	using namespace lazy_types;
+
+	Config c;
+	c.head = 11;
+	c.big = Big{ {1, 2, 3, 4}, "lazily loaded", 0x1122334455667788ull };
+	c.ctor = ptr_types::A(77);
+	c.last = 0xabcd;
+
+	SUBCASE("whole")
+	{
+		archive_vector_out ar(ver_flag_debug_string);
+		ar | c;
+
+		source_buffer sb(ar.data.data(), ar.data.size());
+		archive_whole w(sb);
+		Config x;
+		w | x;
+
+		CHECK(x.head == 11);
+		CHECK(x.last == 0xabcd);
+		CHECK(x.big.is_pending());
+		CHECK(!x.big.is_loaded());
+
+		CHECK(x.big->values == c.big->values);
+		CHECK(x.big->name == c.big->name);
+		CHECK(x.big->tail == c.big->tail);
+		CHECK(x.big.is_loaded());
+		CHECK(!x.big.is_pending());
+		CHECK(x.ctor->x == 77);
+	}
+
+	SUBCASE("copied block keeps alignment")
+	{
+		archive_vector_out ar;
+		u8 misalign = 1;
+		ar | misalign | c;
+
+		archive_vector_in i(ar.data);
+		Config x;
+		u8 m;
+		i | m | x;
+		CHECK(x.big.is_pending());
+
+		// write back without touching, then read again
+		archive_vector_out ar2;
+		ar2 | misalign | x;
+		CHECK(ar2.data == ar.data);
+
+		Config y;
+		archive_vector_in i2(ar2.data);
+		i2 | m | y;
+		CHECK(y.big->values == c.big->values);
+		CHECK(y.big->tail == c.big->tail);
+	}
+
+	SUBCASE("copy outlives the original")
+	{
+		archive_vector_out ar;
+		u8 misalign = 1;
+		ar | misalign | c;
+
+		std::optional<Config> x;
+		x.emplace();
+		archive_vector_in i(ar.data);
+		u8 m;
+		i | m | *x;
+
+		Config y = *x;
+		x.reset();
+		REQUIRE(y.big.is_pending());
+
+		Config z = y;
+		CHECK(y.big->values == c.big->values);
+		CHECK(y.big->name == c.big->name);
+		CHECK(y.ctor->x == 77);
+		y = Config();
+		CHECK(z.big->tail == c.big->tail);
+	}
+
+	SUBCASE("nested blocks borrow from the copied block")
+	{
+		lazy<lazy<std::vector<int>>> n = lazy<std::vector<int>>(std::vector<int>{ 4, 5, 6 });
+		lazy<std::string_view> sv = std::string_view("a view into the block");
+		archive_vector_out ar;
+		ar | n | sv;
+
+		lazy<lazy<std::vector<int>>> ln;
+		lazy<std::string_view> lsv;
+		archive_vector_in in(ar.data);
+		in | ln | lsv;
+		CHECK(ln.is_pending());
+		CHECK(ln->is_pending());
+		CHECK(**ln == std::vector<int>({ 4, 5, 6 }));
+		CHECK(*lsv == "a view into the block");
+
+		// copies share the block the inner views point into
+		std::optional<lazy<std::string_view>> copy(lsv);
+		lsv = lazy<std::string_view>();
+		CHECK(**copy == "a view into the block");
+	}
+}
+
+namespace skip_types
+{
+	struct Old
+	{
+		int a = -1;
+		template<class Ar> void serialize(Ar& ar) { ar | a; }
+	};
+
+	struct New
+	{
+		enum { version = 2 };
+		int a = -1;
+		std::vector<int> more;
+		double last = 0;
+		template<class Ar> void serialize(Ar& ar, unsigned version) {
+			ar | a;
+			if (version >= 2)
+				ar | more | last;
+		}
+	};
+
+	struct Plain
+	{
+		int a;
+		template<class Ar> void serialize(Ar& ar) { ar | a; }
+	};
+
+	struct vector_sink : pulmotor::sink
+	{
+		std::vector<char> data;
+		void write(void const* p, size_t size, std::error_code& ec) override { data.insert(data.end(), (char const*)p, (char const*)p + size); }
+	};
+}
+
+template<> struct pulmotor::class_flags<skip_types::Old> { static constexpr unsigned value = pulmotor::ver_flag_body_size; };
+template<> struct pulmotor::class_flags<skip_types::New> { static constexpr unsigned value = pulmotor::ver_flag_body_size; };
+
+TEST_CASE("body size")
+{
+	using namespace pulmotor;
+	using namespace skip_types;
+
+	New n;
+	n.a = 10;
+	n.more = {1, 2, 3};
+	n.last = 2.5;
+	int after = 0x5a5a;
+
+	archive_vector_out ar;
+	ar | n | after;
+
+	SUBCASE("old reader skips new fields")
+	{
+		Old o;
+		int x = 0;
+		archive_vector_in i(ar.data);
+		i | o | x;
+		CHECK(o.a == 10);
+		CHECK(x == after);
+	}
+
+	SUBCASE("skip object")
+	{
+		Plain p{3};
+		ar | p | after;
+
+		int x = 0, y = 0;
+		archive_vector_in i(ar.data);
+		CHECK(skip_object(i));
+		i | x;
+		CHECK(x == after);
+
+		// no body size, cannot be skipped
+		CHECK(!skip_object(i));
+	}
+
+	SUBCASE("sinks")
+	{
+		vector_sink vs;
+		archive_sink as(vs);
+		as | n | after;
+		CHECK(vs.data == ar.data);
+
+		std::stringstream ss;
+		sink_ostream so(ss);
+		archive_sink aso(so);
+		aso | n | after;
+		std::string s = ss.str();
+		CHECK(std::vector<char>(s.begin(), s.end()) == ar.data);
+	}
+
+	SUBCASE("nested in non-seekable sink")
+	{
+		std::vector<New> v(3, n);
+		ar | v;
+
+		vector_sink vs;
+		archive_sink as(vs, ver_flag_debug_string);
+		archive_vector_out ar2(ver_flag_debug_string);
+		as | n | after | v;
+		ar2 | n | after | v;
+		CHECK(vs.data == ar2.data);
+
+		archive_vector_in i(vs.data);
+		New x;
+		int y;
+		std::vector<Old> xv;
+		i | x | y | xv;
+		CHECK(x.more == n.more);
+		CHECK(xv.size() == 3);
+		CHECK(xv[2].a == 10);
+	}
+}
+
+TEST_CASE("size counter")
+{
+	using namespace pulmotor;
+
+	static_assert(fixed_encoded_size<int>::value == 4);
+	static_assert(fixed_encoded_size<double[3]>::value == 24);
+	static_assert(fixed_encoded_size<std::string>::value == 0);
+
+	auto check_size = [](auto const& o, unsigned flags, size_t lead) {
+		archive_vector_out ar(flags);
+		for (size_t i=0; i<lead; ++i)
+			ar | char(1);
+		size_t before = ar.data.size();
+		size_t expected = encoded_size(o, flags, ar.offset());
+		reserve_for(ar, o);
+		size_t capacity = ar.data.capacity();
+		ar | o;
+		CHECK(ar.data.size() - before == expected);
+		CHECK(ar.data.capacity() == capacity);
+	};
+
+	graph_types::X x{5};
+	graph_types::S s{&x, &x};
+	graph_types::N n3{3}, n2{2, &n3}, n1{1, &n2};
+	n3.next = &n1;
+	skip_types::New sn;
+	sn.more = {1, 2, 3, 4, 5};
+	std::vector<std::string> strings = { "a", "bcd", "" };
+	std::map<int, std::string> m = { { 1, "one" }, { 2, "two" } };
+
+	for (unsigned flags : { 0u, unsigned(ver_flag_debug_string), unsigned(ver_flag_align_object) }) {
+		for (size_t lead : { 0, 1, 3 }) {
+			check_size(7, flags, lead);
+			check_size(1.5, flags, lead);
+			check_size(x, flags, lead);
+			check_size(s, flags, lead);
+			check_size(&n1, flags, lead);
+			check_size(sn, flags, lead);
+			check_size(strings, flags, lead);
+			check_size(m, flags, lead);
+		}
+	}
+
+	archive_size_counter c;
+	c | x | x;
+	CHECK(c.size() == 2 * encoded_size(x));
+}
+
+namespace image_types
+{
+	struct Packet
+	{
+		pulmotor::u16 kind;
+		pulmotor::u32 seq;
+		double value;
+		char tag[6];
+	};
+
+	struct Wrapped
+	{
+		enum { version = pulmotor::no_version };
+		double v;
+		template<class Ar> void serialize(Ar& ar) { ar | v; }
+	};
+}
+
+PULMOTOR_MEMORY_IMAGE(image_types::Packet);
+
+TEST_CASE("memory image")
+{
+	using namespace pulmotor;
+	using image_types::Packet;
+
+	static_assert(fixed_encoded_size<Packet>::value == sizeof(Packet));
+	static_assert(fixed_encoded_size<Packet>::alignment == alignof(Packet));
+	static_assert(fixed_encoded_size<Packet[3]>::value == 3 * sizeof(Packet));
+
+	Packet p { 1, 2, 3.5, "abcde" };
+
+	SUBCASE("single object")
+	{
+		archive_vector_out ar;
+		char c = 'x';
+		ar | c | p;
+		REQUIRE(ar.data.size() == alignof(Packet) + sizeof(Packet));
+		CHECK(memcmp(ar.data.data() + alignof(Packet), &p, sizeof(Packet)) == 0);
+		CHECK(encoded_size(p, 0, 1) == sizeof(Packet) + alignof(Packet) - 1);
+
+		archive_vector_in in(ar.data);
+		Packet l {};
+		in | c | l;
+		CHECK(memcmp(&l, &p, sizeof(Packet)) == 0);
+	}
+
+	SUBCASE("arrays and vectors")
+	{
+		Packet a[3] = { p, p, p };
+		a[2].seq = 7;
+		std::vector<Packet> v(a, a + 3);
+
+		archive_vector_out ar;
+		ar | a | v;
+
+		archive_vector_in in(ar.data);
+		Packet la[3];
+		std::vector<Packet> lv;
+		in | la | lv;
+		CHECK(la[2].seq == 7);
+		REQUIRE(lv.size() == 3);
+		CHECK(memcmp(lv.data(), v.data(), sizeof(Packet) * 3) == 0);
+	}
+
+	SUBCASE("vectors of primitives keep their encoding")
+	{
+		// a no_version wrapper is encoded element by element the same way a double was
+		std::vector<double> d = { 1, 2, 3 }, e;
+		std::vector<image_types::Wrapped> wd = { {1}, {2}, {3} }, we;
+		archive_vector_out ar, ref;
+		char c = 'x';
+		ar | c | d | c | e | d;
+		ref | c | wd | c | we | wd;
+		CHECK(ar.data == ref.data);
+	}
+}
+
+TEST_CASE("buffer archive")
+{
+	using namespace pulmotor;
+
+	skip_types::New n;
+	n.a = 5;
+	n.more = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+	std::vector<std::string> strings = { "first", "second", "third" };
+
+	archive_vector_out ref;
+	ref | n | strings;
+
+	SUBCASE("fits")
+	{
+		char buffer[512];
+		archive_buffer_out ar(buffer);
+		ar | n | strings;
+		CHECK(!ar.failed());
+		CHECK(!ar.spilled());
+		CHECK(ar.data().data() == buffer);
+		CHECK(std::vector<char>(ar.data().begin(), ar.data().end()) == ref.data);
+
+		archive_array_out<512> aa;
+		aa | n | strings;
+		CHECK(std::vector<char>(aa.data().begin(), aa.data().end()) == ref.data);
+	}
+
+	SUBCASE("error")
+	{
+		archive_array_out<16> ar;
+		ar | n | strings;
+		CHECK(ar.failed());
+		CHECK(ar.ec);
+		// the offset still tells how much room was needed
+		CHECK(ar.offset() == ref.data.size());
+	}
+
+	SUBCASE("spill")
+	{
+		archive_array_out<16> ar(0, archive_buffer_out::overflow::spill);
+		ar | n | strings;
+		CHECK(!ar.failed());
+		CHECK(ar.spilled());
+		CHECK(std::vector<char>(ar.data().begin(), ar.data().end()) == ref.data);
+	}
+
+	SUBCASE("callback")
+	{
+		// the object with a body size must fit in one buffer, the rest is spread over many small ones
+		char buffers[64][32];
+		size_t used = 0;
+		std::vector<char> out;
+		auto next = [&](std::span<char> filled) {
+			out.insert(out.end(), filled.begin(), filled.end());
+			return ++used < 64 ? std::span<char>(buffers[used]) : std::span<char>();
+		};
+
+		std::vector<std::string> more = { "x", "yy", "zzz", "a longer string that spans buffers" };
+		archive_vector_out ref2;
+		ref2 | strings | more | strings;
+
+		archive_buffer_out ar(buffers[0], next);
+		ar | strings | more | strings;
+		CHECK(!ar.failed());
+		out.insert(out.end(), ar.data().begin(), ar.data().end());
+		CHECK(out == ref2.data);
+		CHECK(used == (ref2.data.size() - 1) / 32);
+
+		char small[8];
+		archive_buffer_out ar2(small, next);
+		ar2 | n;
+		CHECK(ar2.failed());
+	}
+}
+
+#include <unistd.h>
+
+TEST_CASE("iovec archive")
+{
+	using namespace pulmotor;
+
+	std::vector<double> big(100000);
+	for (size_t i=0; i<big.size(); ++i)
+		big[i] = i * 0.25;
+	skip_types::New n;
+	n.more = { 1, 2, 3 };
+	std::string name = "tensor";
+
+	archive_vector_out ref;
+	ref | name | big | n | big;
+
+	archive_iovec_out ar(1024);
+	ar | name | big | n | big;
+	CHECK(ar.size() == ref.data.size());
+
+	// the arrays are referenced, not copied
+	std::vector<std::pair<void const*, size_t>> segs;
+	ar.for_each_segment([&](void const* p, size_t s) { segs.push_back({p, s}); });
+	CHECK(segs.size() == 4);
+	CHECK(segs[1].first == big.data());
+	CHECK(segs[3].first == big.data());
+
+	SUBCASE("file descriptor")
+	{
+		char path[] = "pulmotor.iovec.test.XXXXXX";
+		int fd = mkstemp(path);
+		REQUIRE(fd != -1);
+		std::error_code ec;
+		ar.flush(fd, ec);
+		CHECK(!ec);
+		CHECK(ar.segment_count() == 0);
+		close(fd);
+
+		std::ifstream f(path, std::ios_base::binary);
+		std::vector<char> written((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+		CHECK(written == ref.data);
+		remove(path);
+	}
+
+	SUBCASE("sink, offsets continue")
+	{
+		skip_types::vector_sink vs;
+		std::error_code ec;
+		ar.flush(vs, ec);
+		ar | name;
+		ar.flush(vs, ec);
+
+		ref | name;
+		CHECK(vs.data == ref.data);
+	}
+
+	SUBCASE("temporaries are copied")
+	{
+		archive_iovec_out t(1);
+		archive_vector_out r;
+		auto put = [](auto& a, u64 k) { u32 x = u32(k) * 3; a | x | vu<u8>(k); };
+		for (u64 k : { 1u, 300u, 70000u, 1u << 30 }) {
+			put(t, k);
+			put(r, k);
+		}
+
+		skip_types::vector_sink vs;
+		std::error_code ec;
+		t.flush(vs, ec);
+		CHECK(vs.data == r.data);
+	}
+}
+
+#include <pulmotor/aligned.hpp>
+
+TEST_CASE("aligned arrays")
+{
+	using namespace pulmotor;
+
+	size_t const ps = util::get_pagesize();
+	std::vector<float> features(ps);
+	for (size_t i=0; i<features.size(); ++i)
+		features[i] = i * 0.5f;
+	std::vector<float> small = { 1, 2, 3 };
+	char const* path = "pulmotor.aligned.test.data";
+
+	{
+		std::ofstream f(path, std::ios_base::binary|std::ios_base::trunc);
+		sink_ostream so(f);
+		archive_sink ar(so);
+		char c = 'x';
+		ar | c | aligned(features) | aligned(small) | c | aligned(features, 64);
+	}
+
+	SUBCASE("mapped")
+	{
+		std::error_code ec;
+		source_mmap sm(path, source_mmap::ro, ec);
+		REQUIRE(!ec);
+		archive_whole ar(sm);
+
+		char c = 0;
+		std::span<float const> a, b, d;
+		ar | c | aligned(a) | aligned(b) | c | aligned(d);
+		CHECK(c == 'x');
+		REQUIRE(a.size() == features.size());
+		CHECK(((uintptr_t)a.data() & (ps - 1)) == 0);
+		CHECK(std::equal(a.begin(), a.end(), features.begin()));
+		CHECK(std::equal(b.begin(), b.end(), small.begin(), small.end()));
+		CHECK(((uintptr_t)d.data() & 63) == 0);
+		CHECK(std::equal(d.begin(), d.end(), features.begin(), features.end()));
+		CHECK(!ar.borrow_writable());
+	}
+
+	SUBCASE("copy on write")
+	{
+		{
+			std::error_code ec;
+			source_mmap sm(path, source_mmap::cow, ec);
+			REQUIRE(!ec);
+			archive_whole ar(sm);
+			CHECK(ar.borrow_writable());
+
+			char c = 0;
+			std::span<float> a;
+			ar | c | aligned(a);
+			a[0] = 100;
+			CHECK(a[0] == 100);
+		}
+
+		std::error_code ec;
+		source_mmap sm(path, source_mmap::ro, ec);
+		archive_whole ar(sm);
+		char c = 0;
+		std::span<float const> a;
+		ar | c | aligned(a);
+		CHECK(a[0] == 0);
+	}
+
+	SUBCASE("copied")
+	{
+		std::ifstream f(path, std::ios_base::binary);
+		std::vector<char> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+		archive_vector_in ar(data);
+
+		char c = 0;
+		std::vector<float> a, b, d;
+		ar | c | aligned(a) | aligned(b) | c | aligned(d);
+		CHECK(a == features);
+		CHECK(b == small);
+		CHECK(d == features);
+	}
+
+	remove(path);
+}
+
+#include <pulmotor/columns.hpp>
+
+namespace column_types {
+
+enum class kind : pulmotor::u8 { a, b, c };
+
+struct Tick
+{
+	double price = 0;
+	pulmotor::u32 volume = 0;
+	kind k = kind::a;
+	pulmotor::u64 time = 0;
+};
+
+}
+
+TEST_CASE("columns")
+{
+	using namespace pulmotor;
+	using namespace column_types;
+
+	std::vector<Tick> ticks(5000);
+	for (size_t i=0; i<ticks.size(); ++i)
+		ticks[i] = Tick { i * 0.5, u32(i * 3), kind(i % 3), 1000000 + i };
+
+	auto all = [](std::vector<Tick>& v) { return columns<&Tick::price, &Tick::volume, &Tick::k, &Tick::time>(v); };
+	auto same = [&ticks](std::vector<Tick> const& l) {
+		REQUIRE(l.size() == ticks.size());
+		bool ok = true;
+		for (size_t i=0; i<l.size(); ++i)
+			ok = ok && l[i].price == ticks[i].price && l[i].volume == ticks[i].volume && l[i].k == ticks[i].k && l[i].time == ticks[i].time;
+		CHECK(ok);
+	};
+
+	archive_vector_out ar;
+	char c = 'x';
+	ar | c | all(ticks) | c;
+	// padding, header, columns (5000 one byte kinds end on a multiple of 8) and the trailing char
+	CHECK(ar.data.size() == 8 + 16 + ticks.size() * (8 + 4 + 1) + ticks.size() * 8 + 1);
+	CHECK(encoded_size(all(ticks)) == 16 + ticks.size() * (8 + 4 + 1) + ticks.size() * 8);
+
+	SUBCASE("all columns")
+	{
+		archive_vector_in in(ar.data);
+		std::vector<Tick> l;
+		char c1 = 0, c2 = 0;
+		in | c1 | all(l) | c2;
+		CHECK(c2 == 'x');
+		same(l);
+
+		source_buffer sb(ar.data.data(), ar.data.size());
+		archive_whole aw(sb);
+		std::vector<Tick> l2;
+		aw | c1 | all(l2) | c2;
+		CHECK(c2 == 'x');
+		same(l2);
+	}
+
+	SUBCASE("selected columns")
+	{
+		source_buffer sb(ar.data.data(), ar.data.size());
+		archive_whole aw(sb);
+		std::vector<Tick> l;
+		char c1 = 0, c2 = 0;
+		aw | c1 | all(l).only<&Tick::time, &Tick::volume>() | c2;
+		CHECK(c2 == 'x');
+		REQUIRE(l.size() == ticks.size());
+		CHECK(l[77].time == ticks[77].time);
+		CHECK(l[77].volume == ticks[77].volume);
+		CHECK(l[77].price == 0);
+		CHECK(l[77].k == kind::a);
+
+		// the rest can be filled in later
+		archive_vector_in in(ar.data);
+		in | c1 | all(l).only<&Tick::price, &Tick::k>() | c2;
+		same(l);
+	}
+
+	SUBCASE("scratch blocks are not referenced")
+	{
+		archive_iovec_out io(64);
+		io | c | all(ticks) | c;
+		skip_types::vector_sink vs;
+		std::error_code ec;
+		io.flush(vs, ec);
+		CHECK(vs.data == ar.data);
+	}
+
+	SUBCASE("empty")
+	{
+		std::vector<Tick> e, l(3);
+		archive_vector_out ar2;
+		ar2 | all(e);
+		archive_vector_in in(ar2.data);
+		in | all(l);
+		CHECK(l.empty());
+	}
+}
+
+#include <pulmotor/packed.hpp>
+
+TEST_CASE("packed integers")
+{
+	using namespace pulmotor;
+
+	auto as_packed = [](auto& v) { return packed(v); };
+	auto as_delta = [](auto& v) { return delta_packed(v); };
+
+	SUBCASE("sorted ids")
+	{
+		std::vector<u64> ids;
+		u64 id = 1ull << 40;
+		for (size_t i=0; i<100000; ++i)
+			ids.push_back(id += 1 + (i * 7919) % 13);
+
+		size_t raw = ids.size() * sizeof(u64);
+		size_t d = round_trip(ids, as_delta);
+		CHECK(d * 8 < raw);
+		size_t f = round_trip(ids, as_packed);
+		CHECK(f > d);
+	}
+
+	SUBCASE("signed and narrow")
+	{
+		std::vector<int> v;
+		for (int i=-500; i<500; ++i)
+			v.push_back(i * 3 % 17);
+		round_trip(v, as_packed);
+		round_trip(v, as_delta);
+
+		std::vector<s8> s = { -128, 127, 0, -1, 1, -128, 127 };
+		round_trip(s, as_packed);
+		round_trip(s, as_delta);
+	}
+
+	SUBCASE("full range")
+	{
+		std::vector<u64> v = { 0, ~u64(0), 1, ~u64(0) - 1, 1ull << 63 };
+		for (size_t i=0; i<300; ++i)
+			v.push_back(u64(i) * 0x9e3779b97f4a7c15ull);
+		round_trip(v, as_packed);
+		round_trip(v, as_delta);
+
+		std::vector<s64> s = { std::numeric_limits<s64>::min(), std::numeric_limits<s64>::max(), 0, -1 };
+		round_trip(s, as_packed);
+		round_trip(s, as_delta);
+	}
+
+	SUBCASE("every width")
+	{
+		// each block spans 0..2^w-1 so block w uses the w-bit kernel
+		std::vector<u64> v;
+		for (unsigned w=0; w<=64; ++w) {
+			u64 top = w == 64 ? ~u64(0) : (u64(1) << w) - 1;
+			for (size_t i=0; i<bitpack::block_values; ++i)
+				v.push_back(i == 0 ? 0 : i == 1 ? top : (i * 0x9e3779b97f4a7c15ull) & top);
+		}
+		round_trip(v, as_packed);
+		round_trip(v, as_delta);
+	}
+
+	SUBCASE("constant and empty")
+	{
+		std::vector<u32> v(1000, 42);
+		// a block of equal values is just its base
+		CHECK(round_trip(v, as_packed) < 200);
+		std::vector<u16> e;
+		round_trip(e, as_delta);
+	}
+
+	SUBCASE("malformed")
+	{
+		std::vector<u32> v(300, 7);
+		archive_vector_out ar;
+		ar | packed(v);
+
+		std::vector<u32> l(3);
+		archive_vector_in wrong(ar.data);
+		wrong | delta_packed(l);
+		CHECK(wrong.ec_);
+		CHECK(l.empty());
+
+		// [u64 count] [u32 delta] [u32 blocks] [u8 widths]
+		std::vector<char> bad = ar.data;
+		bad[16 + 1] = char(65);
+		archive_vector_in in(bad);
+		l.assign(3, 1);
+		in | packed(l);
+		CHECK(in.ec_);
+		CHECK(l.empty());
+
+		bad = ar.data;
+		bad[12] = 9;
+		source_buffer sb(bad.data(), bad.size());
+		archive_whole aw(sb);
+		aw | packed(l);
+		CHECK(aw.ec_);
+	}
+}
+
+#include <pulmotor/timeseries.hpp>
+#include <cmath>
+
+TEST_CASE("timeseries")
+{
+	using namespace pulmotor;
+
+	auto as_timeseries = [](auto& v) { return timeseries(v); };
+
+	SUBCASE("slowly changing")
+	{
+		std::vector<double> gauge;
+		double g = 1000;
+		for (size_t i=0; i<100000; ++i) {
+			if (i % 10 == 0)
+				g += 0.25;
+			gauge.push_back(g);
+		}
+		CHECK(round_trip(gauge, as_timeseries) * 5 < gauge.size() * sizeof(double));
+
+		std::vector<float> f(gauge.begin(), gauge.end());
+		CHECK(round_trip(f, as_timeseries) * 5 < f.size() * sizeof(float));
+	}
+
+	SUBCASE("noisy and special values")
+	{
+		std::vector<double> v;
+		for (size_t i=0; i<5000; ++i)
+			v.push_back(std::sin(i * 0.001) * 1e6);
+		v.push_back(std::numeric_limits<double>::quiet_NaN());
+		v.push_back(std::numeric_limits<double>::infinity());
+		v.push_back(-0.0);
+		v.push_back(std::numeric_limits<double>::denorm_min());
+		v.push_back(0.0);
+		round_trip(v, as_timeseries);
+
+		std::vector<float> f(v.begin(), v.end());
+		round_trip(f, as_timeseries);
+	}
+
+	SUBCASE("short")
+	{
+		std::vector<double> e, one = { 3.5 }, two = { 3.5, -3.5 };
+		round_trip(e, as_timeseries);
+		round_trip(one, as_timeseries);
+		round_trip(two, as_timeseries);
+	}
+
+	SUBCASE("malformed")
+	{
+		// [u64 count] [u64 word count] [u64 words]*
+		auto load = [](std::initializer_list<u64> words) {
+			std::vector<char> data(words.size() * sizeof(u64));
+			memcpy(data.data(), words.begin(), data.size());
+			std::vector<double> l(3);
+			archive_vector_in in(data);
+			in | timeseries(l);
+			CHECK(in.ec_);
+			CHECK(l.empty());
+		};
+
+		// '1' '1', 31 leading zeros and 64 changed bits do not fit a double
+		load({ 3, 2, 0, 0b11 | 31 << 2 | 63 << 7 });
+		// more values than the stream has bits for
+		load({ 1000, 1, 0 });
+		// enough bits for the count, but every value asks for a full window
+		load({ 65, 2, 0, ~u64(0) });
+	}
+}
+
+#include <pulmotor/bits.hpp>
+#include <pulmotor/std/bitset.hpp>
+
+namespace bit_types {
+
+enum class mode : pulmotor::u8 { idle, walk, run, fly, swim };
+
+struct Entity
+{
+	mode m = mode::idle;
+	bool visible = false, solid = false, dirty = false;
+	int lean = 0; // -8..7
+	unsigned team = 0;
+
+	template<class Ar>
+	void serialize(Ar& ar, unsigned version) {
+		ar | pulmotor::bit_fields(pulmotor::bits<3>(m), visible, solid, dirty, pulmotor::bits<4>(lean), pulmotor::bits<6>(team));
+	}
+};
+
+}
+
+TEST_CASE("bit packing")
+{
+	using namespace pulmotor;
+	using namespace bit_types;
+
+	SUBCASE("fields")
+	{
+		Entity e { mode::fly, true, false, true, -5, 42 };
+		archive_vector_out ar;
+		ar | e;
+		// the 16 bits of the fields after the version prefix
+		CHECK(ar.data.size() == sizeof(u32) + 2);
+
+		archive_vector_in in(ar.data);
+		Entity l;
+		in | l;
+		CHECK(l.m == mode::fly);
+		CHECK(l.visible);
+		CHECK(!l.solid);
+		CHECK(l.dirty);
+		CHECK(l.lean == -5);
+		CHECK(l.team == 42);
+	}
+
+	SUBCASE("single and wide")
+	{
+		u64 big = 0x123456789abcdefull, big2 = 0;
+		s16 neg = -300, neg2 = 0;
+		char c = 'x', c2 = 0;
+		archive_vector_out ar;
+		ar | bits<60>(big) | c | bits<10>(neg);
+		CHECK(ar.data.size() == 8 + 1 + 2);
+
+		archive_vector_in in(ar.data);
+		in | bits<60>(big2) | c2 | bits<10>(neg2);
+		CHECK(big2 == big);
+		CHECK(c2 == c);
+		CHECK(neg2 == neg);
+	}
+
+	SUBCASE("vector<bool> and bitset")
+	{
+		std::vector<bool> flags(5000);
+		for (size_t i=0; i<flags.size(); ++i)
+			flags[i] = i % 3 == 0 || i % 7 == 0;
+		std::vector<bool> empty;
+		std::bitset<10> small("1011001110");
+		std::bitset<200> large;
+		large[0] = large[63] = large[64] = large[199] = true;
+
+		archive_vector_out ar;
+		ar | flags | empty | small | large;
+		// the second vector's prefix is aligned to 4
+		CHECK(ar.data.size() == 4 + 4 + 625 + 3 + 4 + 4 + 2 + 25);
+
+		archive_vector_in in(ar.data);
+		std::vector<bool> l(3, true), le(2);
+		std::bitset<10> s;
+		std::bitset<200> g;
+		in | l | le | s | g;
+		CHECK(l == flags);
+		CHECK(le.empty());
+		CHECK(s == small);
+		CHECK(g == large);
+
+		// lowest bits first
+		size_t at = ar.data.size() - 25;
+		CHECK(u8(ar.data[at - 2]) == 0xce);
+		CHECK(u8(ar.data[at - 1]) == 0x02);
+		CHECK(u8(ar.data[at]) == 0x01);
+		CHECK(u8(ar.data[at + 7]) == 0x80);
+		CHECK(u8(ar.data[at + 8]) == 0x01);
+		CHECK(u8(ar.data[at + 24]) == 0x80);
+
+		// stray bits past N are dropped
+		std::vector<char> bad = ar.data;
+		bad[at - 1] = char(0xfe);
+		archive_vector_in in2(bad);
+		in2 | l | le | s;
+		CHECK(s == small);
+		CHECK(s.count() == small.count());
+
+		// flip() may set the unused bits of the last word, they are not written
+		for (size_t n : { 1, 7, 8, 13, 63, 64, 65, 130 }) {
+			std::vector<bool> f(n);
+			f[0] = true;
+			f.flip();
+			archive_vector_out fo;
+			fo | f;
+			// the same 8 byte prefix as above, then the bytes
+			REQUIRE(fo.data.size() == 8 + (n + 7) / 8);
+			if (n & 7)
+				CHECK((u8(fo.data.back()) >> (n & 7)) == 0);
+
+			archive_vector_in fi(fo.data);
+			std::vector<bool> lf(200, true);
+			fi | lf;
+			CHECK(lf == f);
+		}
+	}
+}
+
+#include <pulmotor/rle.hpp>
+
+TEST_CASE("run length")
+{
+	using namespace pulmotor;
+
+	auto as_rle = [](auto& v) { return rle(v); };
+
+	SUBCASE("sparse grid")
+	{
+		std::vector<u8> grid(256 * 256);
+		for (size_t y=100; y<120; ++y)
+			for (size_t x=30; x<90; ++x)
+				grid[y * 256 + x] = 1;
+		grid[5] = 7;
+		CHECK(round_trip(grid, as_rle) < 200);
+	}
+
+	SUBCASE("histogram")
+	{
+		std::vector<float> h(10000, 0.f);
+		for (size_t i=0; i<h.size(); i+=997)
+			h[i] = float(i);
+		std::fill(h.begin() + 2000, h.begin() + 3000, 0.5f);
+		h[5000] = -0.f;
+		h[5001] = std::numeric_limits<float>::quiet_NaN();
+		CHECK(round_trip(h, as_rle) < 200);
+	}
+
+	SUBCASE("no runs")
+	{
+		std::vector<s32> v;
+		for (int i=0; i<1000; ++i)
+			v.push_back(i * 7 - 3000);
+		// a single literal
+		CHECK(round_trip(v, as_rle) <= 8 + 16 + 2 + 4000 + 1);
+
+		std::vector<double> e, z(1);
+		round_trip(e, as_rle);
+		round_trip(z, as_rle);
+	}
+
+	SUBCASE("runs across words")
+	{
+		std::vector<u8> b;
+		std::vector<u16> w;
+		for (unsigned n=1; n<40; ++n) {
+			b.insert(b.end(), n, u8(n & 3));
+			w.insert(w.end(), n, u16(n % 5 * 0x101));
+		}
+		round_trip(b, as_rle);
+		round_trip(w, as_rle);
+	}
+
+	SUBCASE("malformed")
+	{
+		// [u64 count] [u64 byte size] [runs]
+		auto load = [](u64 count, std::vector<u8> runs) {
+			u64 size = runs.size();
+			std::vector<char> data(16);
+			memcpy(data.data(), &count, 8);
+			memcpy(data.data() + 8, &size, 8);
+			data.insert(data.end(), runs.begin(), runs.end());
+
+			std::vector<u16> l(3);
+			archive_vector_in in(data);
+			in | rle(l);
+			CHECK(in.ec_);
+			CHECK(l.empty());
+		};
+
+		load(5, { 0x80 }); // token cut short
+		load(5, { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01 }); // token too long
+		load(2, { 5 << 2 | rle_coding::zeros }); // more values than the count
+		load(10, { 2 << 2 | rle_coding::zeros }); // fewer values than the count
+		load(4, { 4 << 2 | rle_coding::literal, 1, 2 }); // literal cut short
+	}
+}
+
+#include <pulmotor/shuffle.hpp>
+
+TEST_CASE("byte shuffle")
+{
+	using namespace pulmotor;
+
+	std::vector<float> v;
+	for (size_t i=0; i<10000; ++i)
+		v.push_back(20.f + std::sin(i * 0.01f));
+
+	archive_vector_out ar;
+	char c = 'x';
+	ar | c | shuffled(v) | c;
+	CHECK(ar.data.size() == 8 + 8 + v.size() * sizeof(float) + 1);
+
+	// the top byte plane is (nearly) constant
+	char const* top = ar.data.data() + 16 + 3 * v.size();
+	CHECK(std::count(top, top + v.size(), top[0]) == v.size());
+
+	std::vector<float> raw(v.size());
+	unshuffle_bytes<sizeof(float)>(ar.data.data() + 16, v.size(), raw.data());
+	CHECK(raw == v);
+	std::vector<char> again(v.size() * sizeof(float));
+	shuffle_bytes<sizeof(float)>(v.data(), v.size(), again.data());
+	CHECK(std::equal(again.begin(), again.end(), ar.data.begin() + 16));
+
+	archive_vector_in in(ar.data);
+	std::vector<float> l(3);
+	char c1 = 0, c2 = 0;
+	in | c1 | shuffled(l) | c2;
+	CHECK(c2 == 'x');
+	CHECK(l == v);
+
+	source_buffer sb(ar.data.data(), ar.data.size());
+	archive_whole aw(sb);
+	std::vector<float> l2;
+	aw | c1 | shuffled(l2) | c2;
+	CHECK(c2 == 'x');
+	CHECK(l2 == v);
+
+	std::vector<u64> e, le(2);
+	archive_vector_out ar2;
+	ar2 | shuffled(e);
+	archive_vector_in in2(ar2.data);
+	in2 | shuffled(le);
+	CHECK(le.empty());
+}
+
+#include <pulmotor/auto_encode.hpp>
+
+TEST_CASE("auto encode")
+{
+	using namespace pulmotor;
+
+	auto encoded = [](auto& v, encode_policy policy, array_encoding& tag) {
+		archive_vector_out ar;
+		ar | auto_encode(v, policy);
+		tag = array_encoding(ar.data[0]);
+		return round_trip(v, [policy](auto& x) { return auto_encode(x, policy); });
+	};
+	array_encoding tag;
+
+	SUBCASE("picks by data")
+	{
+		std::vector<u64> ids;
+		for (u64 i=0, id=1ull << 40; i<50000; ++i)
+			ids.push_back(id += 1 + i % 5);
+		encoded(ids, encode_policy::size, tag);
+		CHECK(tag == array_encoding::delta_packed);
+
+		std::vector<s32> narrow;
+		for (int i=0; i<50000; ++i)
+			narrow.push_back((i * 7919) % 1000 - 500);
+		encoded(narrow, encode_policy::size, tag);
+		CHECK(tag == array_encoding::packed);
+
+		std::vector<double> sparse(50000);
+		sparse[100] = 1;
+		sparse[40000] = 2;
+		CHECK(encoded(sparse, encode_policy::size, tag) < 100);
+		CHECK(tag == array_encoding::rle);
+
+		std::vector<float> labels;
+		for (int i=0; i<50000; ++i)
+			labels.push_back(float((i * 7919) % 13) * 0.1f);
+		encoded(labels, encode_policy::size, tag);
+		CHECK(tag == array_encoding::dictionary);
+
+		std::vector<double> noise;
+		for (int i=0; i<5000; ++i)
+			noise.push_back(std::sin(i * 1.7) * 1e3);
+		encoded(noise, encode_policy::size, tag);
+		CHECK(tag == array_encoding::raw);
+
+		std::vector<u32> skewed;
+		for (u32 i=0; i<5000; ++i)
+			skewed.push_back(i % 64 == 0 ? 1u << 30 : (i * 7919) % 1000);
+		encoded(skewed, encode_policy::size, tag);
+		CHECK(tag == array_encoding::varint);
+	}
+
+	SUBCASE("speed policy")
+	{
+		std::vector<s32> narrow;
+		for (int i=0; i<50000; ++i)
+			narrow.push_back((i * 7919) % 1000 - 500);
+		size_t small = encoded(narrow, encode_policy::size, tag);
+		size_t fast = encoded(narrow, encode_policy::speed, tag);
+		CHECK(fast <= small * 5 / 4 + 16);
+	}
+
+	SUBCASE("dictionary fallback")
+	{
+		// few distinct values in the sampled windows, many elsewhere
+		std::vector<u16> v(50000, 3);
+		for (size_t i=0; i<v.size(); ++i)
+			if ((i / 128) % 7 == 3)
+				v[i] = u16(i);
+		encoded(v, encode_policy::size, tag);
+		CHECK(tag != array_encoding::dictionary);
+	}
+
+	SUBCASE("explicit encodings")
+	{
+		std::vector<s64> v = { 0, -1, 1, std::numeric_limits<s64>::min(), std::numeric_limits<s64>::max(), 300, -300 };
+		archive_vector_out ar;
+		ar | varint(v) | dictionary(v);
+		archive_vector_in in(ar.data);
+		std::vector<s64> a, b;
+		in | varint(a) | dictionary(b);
+		CHECK(a == v);
+		CHECK(b == v);
+
+		std::vector<u8> e;
+		encoded(e, encode_policy::size, tag);
+	}
+
+	SUBCASE("malformed dictionary")
+	{
+		std::vector<u32> v = { 5, 9, 5, 9, 7 };
+		archive_vector_out ar;
+		ar | dictionary(v);
+
+		// [u64 count] [u32 size] [u32 width] [u32 values]* [padding] [u64 words]
+		std::vector<char> bad = ar.data;
+		bad[12] = 40;
+		archive_vector_in in(bad);
+		std::vector<u32> l(3);
+		in | dictionary(l);
+		CHECK(in.ec_);
+		CHECK(l.empty());
+
+		bad = ar.data;
+		bad[32] = char(0xff);
+		source_buffer sb(bad.data(), bad.size());
+		archive_whole aw(sb);
+		aw | dictionary(l);
+		CHECK(aw.ec_);
+		CHECK(l.empty());
+
+		std::vector<char> unknown(16, 0);
+		unknown[0] = 9;
+		archive_vector_in in2(unknown);
+		l.assign(2, 1);
+		in2 | auto_encode(l);
+		CHECK(in2.ec_);
+		CHECK(l.empty());
+	}
+
+	SUBCASE("malformed varint")
+	{
+		// [u64 count] [u64 byte size] [bytes]
+		auto load = [](u64 count, std::vector<u8> bytes) {
+			u64 size = bytes.size();
+			std::vector<char> data(16);
+			memcpy(data.data(), &count, 8);
+			memcpy(data.data() + 8, &size, 8);
+			data.insert(data.end(), bytes.begin(), bytes.end());
+
+			std::vector<u64> l(3);
+			source_buffer sb(data.data(), data.size());
+			archive_whole aw(sb);
+			aw | varint(l);
+			if (aw.ec_)
+				CHECK(l.empty());
+			return !aw.ec_;
+		};
+
+		CHECK(!load(3, { 0x81, 0x01 })); // more values than bytes
+		CHECK(!load(2, { 0x81, 0x01 })); // the second value is missing
+		CHECK(!load(1, { 0x81, 0x81 })); // the last byte continues
+		CHECK(!load(1, { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02 })); // past 64 bits
+		CHECK(!load(1, { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x81, 0x00 })); // over ten bytes
+		CHECK(load(1, { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01 }));
+	}
+}
+
+#include <pulmotor/quantize.hpp>
+
+TEST_CASE("quantization")
+{
+	using namespace pulmotor;
+
+	SUBCASE("half float conversion")
+	{
+		CHECK(f16::from_float(1.f) == 0x3c00);
+		CHECK(f16::from_float(-2.f) == 0xc000);
+		CHECK(f16::from_float(65504.f) == 0x7bff);
+		CHECK(f16::from_float(65520.f) == 0x7c00);
+		CHECK(f16::from_float(std::numeric_limits<float>::infinity()) == 0x7c00);
+		CHECK(f16::from_float(5.9604645e-8f) == 0x0001);
+		CHECK(f16::from_float(1.f + 1.f / 4096) == 0x3c00); // ties to even
+		CHECK(f16::to_float(0x0001) == 5.9604645e-8f);
+		CHECK(f16::to_float(0x3555) == 0.333251953125f);
+		CHECK(std::isnan(f16::to_float(f16::from_float(std::numeric_limits<float>::quiet_NaN()))));
+
+		// every half value converts back to itself
+		bool ok = true;
+		for (u32 h=0; h<0x10000; ++h)
+			if ((h & 0x7c00) != 0x7c00 || (h & 0x3ff) == 0)
+				ok = ok && f16::from_float(f16::to_float(u16(h))) == h;
+		CHECK(ok);
+
+		CHECK(f16::bf_from_float(1.f) == 0x3f80);
+		CHECK(f16::bf_to_float(0x3f80) == 1.f);
+		CHECK(f16::bf_from_float(1.00390625f) == 0x3f80); // ties to even
+	}
+
+	std::vector<float> features;
+	for (int i=0; i<1000; ++i)
+		features.push_back(std::sin(i * 0.37f) * 10.f);
+
+	auto load = [](archive_vector_out const& ar, auto wrap) {
+		std::vector<float> l(3), l2;
+		archive_vector_in in(ar.data);
+		char c1 = 0, c2 = 0;
+		in | c1 | wrap(l) | c2;
+		CHECK(c2 == 'x');
+
+		source_buffer sb(ar.data.data(), ar.data.size());
+		archive_whole aw(sb);
+		aw | c1 | wrap(l2) | c2;
+		CHECK(l2 == l);
+		return l;
+	};
+	auto max_error = [&features](std::vector<float> const& l) {
+		REQUIRE(l.size() == features.size());
+		float e = 0;
+		for (size_t i=0; i<l.size(); ++i)
+			e = std::max(e, std::abs(l[i] - features[i]));
+		return e;
+	};
+
+	SUBCASE("16 bit floats")
+	{
+		archive_vector_out ar;
+		char c = 'x';
+		ar | c | half_float(features) | c;
+		CHECK(ar.data.size() == 8 + 8 + features.size() * 2 + 1);
+		CHECK(max_error(load(ar, [](auto& v) { return half_float(v); })) <= 10.f / 2048);
+
+		archive_vector_out ar2;
+		ar2 | c | bfloat16(features) | c;
+		CHECK(max_error(load(ar2, [](auto& v) { return bfloat16(v); })) <= 10.f / 256);
+	}
+
+	SUBCASE("fixed point")
+	{
+		auto check_bits = [&](auto bits_c) {
+			constexpr unsigned bits = decltype(bits_c)::value;
+			archive_vector_out ar;
+			char c = 'x';
+			ar | c | quantize<bits>(features) | c;
+
+			// the bit count comes from the data
+			std::vector<float> l = load(ar, [](auto& v) { return quantize<8>(v); });
+			float step = 20.f / float((u64(1) << bits) - 1);
+			CHECK(max_error(l) <= step / 2 * 1.001f + 1e-5f);
+			CHECK(*std::max_element(l.begin(), l.end()) == *std::max_element(features.begin(), features.end()));
+			CHECK(*std::min_element(l.begin(), l.end()) == *std::min_element(features.begin(), features.end()));
+		};
+		check_bits(std::integral_constant<unsigned, 1>());
+		check_bits(std::integral_constant<unsigned, 4>());
+		check_bits(std::integral_constant<unsigned, 8>());
+		check_bits(std::integral_constant<unsigned, 12>());
+		check_bits(std::integral_constant<unsigned, 32>());
+
+		std::vector<double> flat(10, 3.25), e, lf, le(2);
+		archive_vector_out ar;
+		ar | quantize<8>(flat) | quantize<8>(e);
+		archive_vector_in in(ar.data);
+		in | quantize<8>(lf) | quantize<8>(le);
+		CHECK(lf == flat);
+		CHECK(le.empty());
+
+		// [u64 count] [u32 bits]
+		std::vector<char> bad = ar.data;
+		bad[8] = 40;
+		archive_vector_in in2(bad);
+		lf.assign(2, 1.0);
+		in2 | quantize<8>(lf);
+		CHECK(in2.ec_);
+		CHECK(lf.empty());
+	}
+}
+
+#include <pulmotor/string_table.hpp>
+
+TEST_CASE("string table")
+{
+	using namespace pulmotor;
+
+	std::vector<std::string> tags;
+	char const* names[] = { "region:eu-west", "service:frontend", "env:production", "" };
+	for (size_t i=0; i<1000; ++i)
+		tags.push_back(names[i % 4]);
+	std::map<std::string, int> counts = { { "region:eu-west", 1 }, { "other", 2 } };
+
+	archive_vector_out plain;
+	plain | tags | counts;
+
+	string_table wt;
+	archive_vector_out ar;
+	ar.set_string_table(&wt);
+	ar | tags | counts;
+	CHECK(wt.size() == 5);
+	CHECK(wt.references() == 997);
+	CHECK(ar.data.size() * 10 < plain.data.size());
+
+	SUBCASE("strings")
+	{
+		string_table rt;
+		archive_vector_in in(ar.data);
+		in.set_string_table(&rt);
+		std::vector<std::string> l;
+		std::map<std::string, int> lc;
+		in | l | lc;
+		CHECK(l == tags);
+		CHECK(lc == counts);
+		CHECK(rt.size() == 5);
+	}
+
+	SUBCASE("interned views")
+	{
+		string_table t;
+		archive_vector_out o;
+		o.set_string_table(&t);
+		for (std::string const& tag : tags) {
+			std::string_view v = tag;
+			o | interned(v);
+		}
+
+		string_table rt;
+		archive_vector_in in(o.data);
+		in.set_string_table(&rt);
+		std::vector<std::string_view> l(tags.size());
+		for (std::string_view& v : l)
+			in | interned(v);
+		CHECK(!in.ec_);
+		CHECK(std::equal(l.begin(), l.end(), tags.begin()));
+		// equal strings share one copy
+		CHECK(l[0].data() == l[4].data());
+		CHECK(l[1].data() == l[997].data());
+	}
+
+	SUBCASE("cleared between records")
+	{
+		string_table t;
+		archive_vector_out rec;
+		rec.set_string_table(&t);
+		std::string a = "same", b = "same";
+		rec | a;
+		t.clear();
+		rec | b;
+		CHECK(t.references() == 0);
+
+		string_table rt;
+		archive_vector_in in(rec.data);
+		in.set_string_table(&rt);
+		std::string la, lb;
+		in | la;
+		rt.clear();
+		in | lb;
+		CHECK(la == a);
+		CHECK(lb == b);
+	}
+
+	SUBCASE("interned views without a table")
+	{
+		std::string_view v = "not interned";
+		int after = 77;
+		archive_vector_out o;
+		o | interned(v) | after;
+
+		// a borrowing archive points into the source
+		source_buffer sb(o.data.data(), o.data.size());
+		archive_whole aw(sb);
+		std::string_view bv;
+		int ba = 0;
+		aw | interned(bv) | ba;
+		CHECK(!aw.ec_);
+		CHECK(bv == v);
+		CHECK(ba == after);
+
+		std::string_view lv = "previous";
+		int la = 0;
+		archive_vector_in in(o.data);
+		in | interned(lv) | la;
+		CHECK(in.ec_ == std::errc::not_supported);
+		CHECK(lv.empty());
+		CHECK(la == after);
+	}
+
+	SUBCASE("unknown reference")
+	{
+		// [vu ref] of a string that was never written
+		std::vector<char> bad = { 3 };
+		string_table rt;
+		archive_vector_in in(bad);
+		in.set_string_table(&rt);
+		std::string_view lv = "previous";
+		std::string ls = "previous";
+		in | interned(lv);
+		CHECK(in.ec_);
+		CHECK(lv.empty());
+
+		archive_vector_in in2(bad);
+		in2.set_string_table(&rt);
+		in2 | ls;
+		CHECK(in2.ec_);
+		CHECK(ls.empty());
+	}
+}